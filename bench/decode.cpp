@@ -0,0 +1,80 @@
+// Decode microbenchmark: WavFile::decode against the former scalar loop
+//
+//   g++ -O2 -std=c++17 -pthread bench/decode.cpp -o decode && ./decode
+
+#include "../wave.hpp"
+
+#include <chrono>
+
+#define READ_SAMPLES(type, scale)                                \
+    for (uint32_t i = 0; i < frames; i++) {                      \
+        for (uint32_t c = 0; c < channels; c++) {                \
+            type sample = ((type*)src)[i * channels + c];        \
+            dst[c][i]   = sample * (scale);                      \
+        }                                                        \
+    }
+static void decodeScalar(const void* src, float** dst, uint32_t frames,
+                         uint32_t channels, uint32_t bits) {
+    switch (bits) {
+    case 8: {
+        READ_SAMPLES(int8_t, 1 / 128.f);
+    } break;
+    case 16: {
+        READ_SAMPLES(int16_t, 1 / 32768.f);
+    } break;
+    case 32: {
+        READ_SAMPLES(int32_t, 1 / 2147483648.f);
+    } break;
+    }
+}
+#undef READ_SAMPLES
+
+static double seconds() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int main() {
+    const uint32_t frames     = 1 << 20;
+    const int      repeats    = 10;
+    uint32_t       bitsList[] = {8, 16, 32};
+    uint32_t       chList[]   = {1, 2, 6, 8};
+
+    printf("%-6s %-8s %12s %12s %8s\n", "bits", "channels", "scalar MB/s",
+           "decode MB/s", "speedup");
+
+    for (uint32_t bits : bitsList) {
+        for (uint32_t channels : chList) {
+            size_t   bytes = (size_t)frames * channels * bits / 8;
+            uint8_t* src   = (uint8_t*)malloc(bytes);
+            for (size_t i = 0; i < bytes; i++)
+                src[i] = (uint8_t)(i * 2654435761u >> 13);
+
+            float** dst = (float**)malloc(channels * sizeof(float*));
+            for (uint32_t c = 0; c < channels; c++)
+                dst[c] = (float*)malloc(frames * sizeof(float));
+
+            double start = seconds();
+            for (int r = 0; r < repeats; r++)
+                decodeScalar(src, dst, frames, channels, bits);
+            double scalar = seconds() - start;
+
+            start = seconds();
+            for (int r = 0; r < repeats; r++)
+                WavFile::decode(src, dst, 0, frames, channels, bits, PCM);
+            double simd = seconds() - start;
+
+            printf("%-6u %-8u %12.0f %12.0f %7.2fx\n", bits, channels,
+                   bytes * repeats / scalar / 1e6, bytes * repeats / simd / 1e6,
+                   scalar / simd);
+
+            for (uint32_t c = 0; c < channels; c++)
+                free(dst[c]);
+            free(dst);
+            free(src);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+// Benchmark suite: every read, conversion and write path over synthetic files
+//
+//   g++ -O2 -std=c++17 -pthread bench/suite.cpp -o suite && ./suite > results.jsonl
+//
+// Options:
+//   --quick          Smaller files and fewer repeats
+//   --filter <text>  Only run cases whose name contains text
+//   --dir <path>     Where the generated files go (default /tmp)
+//
+// A file without a data chunk is opened through every reader first; each
+// should report NO_DATA (filter on noData to run only that check).
+//
+// Every measurement is printed as one JSON object per line, so two runs
+// can be diffed or loaded into anything that reads JSON Lines. Times are the
+// best of several repeats, allocation counts are per call.
+
+#include "../wave.hpp"
+
+#include <chrono>
+#include <string>
+
+// Synthetic files
+
+struct Shape {
+    uint16_t    type;
+    uint16_t    bits;
+    uint16_t    channels;
+    uint32_t    frames;
+    const char* layout; // plain, chunks or large-chunk
+};
+
+static void writeChunk(FILE* file, const char* tag, uint32_t size, uint8_t fill) {
+    fwrite(tag, 4, 1, file);
+    fwrite(&size, 4, 1, file);
+    for (uint32_t i = 0; i < size + size % 2; i++)
+        fputc(fill, file);
+}
+
+// fmt, then depending on the layout metadata chunks before and after the
+// samples, or one large chunk readMinimal has to skip
+static void generate(const char* path, const Shape& shape) {
+    uint32_t blockSize = shape.channels * shape.bits / 8;
+    uint32_t dataSize  = shape.frames * blockSize;
+
+    std::string layout = shape.layout;
+    uint32_t    before = layout == "chunks" ? 2048 : layout == "large-chunk" ? 16 << 20 : 0;
+    uint32_t    after  = layout == "chunks" ? 512 : 0;
+
+    uint32_t riffSize = 4 + 24 + 8 + dataSize + dataSize % 2;
+    if (before != 0)
+        riffSize += 8 + before;
+    if (after != 0)
+        riffSize += 8 + after;
+
+    FILE* file = fopen(path, "wb");
+    fwrite("RIFF", 4, 1, file);
+    fwrite(&riffSize, 4, 1, file);
+    fwrite("WAVE", 4, 1, file);
+
+    struct WavFile::Format format;
+    memcpy(format.FMT, "fmt ", 4);
+    format.formatSize    = 16;
+    format.formatType    = shape.type;
+    format.channels      = shape.channels;
+    format.sampleRate    = 48000;
+    format.byteRate      = 48000 * blockSize;
+    format.blockSize     = blockSize;
+    format.bitsPerSample = shape.bits;
+    fwrite(&format, sizeof(format), 1, file);
+
+    if (before != 0)
+        writeChunk(file, "LIST", before, 'm');
+
+    // Samples in range for every format, float ones within [-1, 1)
+    fwrite("data", 4, 1, file);
+    fwrite(&dataSize, 4, 1, file);
+    uint8_t  block[1 << 16];
+    uint32_t state = 0x9E3779B9;
+    for (uint32_t done = 0; done < dataSize; done += sizeof(block)) {
+        uint32_t n = dataSize - done < sizeof(block) ? dataSize - done : sizeof(block);
+        for (uint32_t i = 0; i < n; i++) {
+            state    = state * 1664525 + 1013904223;
+            block[i] = state >> 24;
+        }
+        if (shape.type == FLOAT && shape.bits == 32)
+            for (uint32_t i = 0; i + 4 <= n; i += 4) {
+                float sample = (int8_t)block[i] / 128.f;
+                memcpy(block + i, &sample, 4);
+            }
+        fwrite(block, n, 1, file);
+    }
+    if (dataSize % 2 != 0)
+        fputc(0, file);
+
+    if (after != 0)
+        writeChunk(file, "bext", after, 'b');
+    fclose(file);
+}
+
+// A file with padding and a format but no data chunk. Every open path has
+// to give up with NO_DATA rather than keep seeking at the end of the file.
+static void checkNoData(const char* dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/wavbench-nodata.wav", dir);
+
+    uint32_t riffSize = 4 + 8 + 6 + 24;
+    FILE*    file     = fopen(path, "wb");
+    fwrite("RIFF", 4, 1, file);
+    fwrite(&riffSize, 4, 1, file);
+    fwrite("WAVE", 4, 1, file);
+    writeChunk(file, "JUNK", 6, 0);
+
+    struct WavFile::Format format;
+    memcpy(format.FMT, "fmt ", 4);
+    format.formatSize    = 16;
+    format.formatType    = PCM;
+    format.channels      = 2;
+    format.sampleRate    = 48000;
+    format.byteRate      = 48000 * 4;
+    format.blockSize     = 4;
+    format.bitsPerSample = 16;
+    fwrite(&format, sizeof(format), 1, file);
+    fclose(file);
+
+    auto check = [](const char* op, WavError error) {
+        printf("{\"op\":\"noData/%s\",\"error\":%d,\"ok\":%s}\n", op, error,
+               error == NO_DATA ? "true" : "false");
+        fflush(stdout);
+    };
+
+    WavFile minimal, read, probed, mapped;
+    file = fopen(path, "rb");
+    check("readMinimal", minimal.readMinimal(file));
+    fclose(file);
+    file = fopen(path, "rb");
+    check("read", read.read(file));
+    fclose(file);
+    file = fopen(path, "rb");
+    check("probe", probed.probe(file));
+    fclose(file);
+    check("map", mapped.map(path));
+
+    WavStreamReader stream;
+    file = fopen(path, "rb");
+    check("WavStreamReader", stream.open(file));
+    fclose(file);
+
+    WavFrameReader frames;
+    check("WavFrameReader", frames.open(path));
+
+    WavPrefetchReader prefetch;
+    check("WavPrefetchReader", prefetch.open(path));
+
+    remove(path);
+}
+
+// Allocation counting
+
+struct Counter {
+    size_t calls;
+    size_t bytes;
+};
+
+static void* countingAlloc(void* context, size_t size, size_t alignment) {
+    Counter* counter = (Counter*)context;
+    counter->calls++;
+    counter->bytes += size;
+    return WavAllocator::heapAlloc(nullptr, size, alignment);
+}
+
+static void countingFree(void*, void* ptr) { ::free(ptr); }
+
+// Timing
+
+struct Result {
+    double seconds; // Best of the repeats
+    Counter allocations;
+};
+
+static double now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Runs op until both minRepeats and minSeconds are reached, keeping the best
+// time. Allocations are those of the last run.
+template <typename F>
+static Result measure(Counter& counter, int minRepeats, double minSeconds, const F& op) {
+    Result result = {1e30, {}};
+    double start  = now();
+    for (int i = 0; i < minRepeats || now() - start < minSeconds; i++) {
+        counter        = {};
+        double begin   = now();
+        op();
+        double elapsed = now() - begin;
+        if (elapsed < result.seconds)
+            result.seconds = elapsed;
+        result.allocations = counter;
+    }
+    return result;
+}
+
+static void report(const char* op, const Shape& shape, const Result& result) {
+    double bytes = (double)shape.frames * shape.channels * shape.bits / 8;
+    printf("{\"op\":\"%s\",\"type\":\"%s\",\"bits\":%u,\"channels\":%u,\"frames\":%u,"
+           "\"layout\":\"%s\",\"seconds\":%.9f,\"mb_per_s\":%.1f,\"frames_per_s\":%.0f,"
+           "\"allocs\":%zu,\"alloc_bytes\":%zu}\n",
+           op, shape.type == FLOAT ? "float" : "pcm", shape.bits, shape.channels,
+           shape.frames, shape.layout, result.seconds, bytes / result.seconds / 1e6,
+           shape.frames / result.seconds, result.allocations.calls,
+           result.allocations.bytes);
+    fflush(stdout);
+}
+
+static void run(const Shape& shape, const char* dir, int repeats, double minSeconds) {
+    char path[512], out[520];
+    snprintf(path, sizeof(path), "%s/wavbench-%u-%u-%u-%s.wav", dir, shape.bits,
+             shape.channels, shape.frames, shape.layout);
+    snprintf(out, sizeof(out), "%s.out", path);
+    generate(path, shape);
+
+    Counter      counter = {};
+    WavAllocator counting = {countingAlloc, countingFree, &counter};
+
+    report("readMinimal", shape, measure(counter, repeats, minSeconds, [&] {
+               FILE*   file = fopen(path, "rb");
+               WavFile wav(counting);
+               wav.readMinimal(file);
+               fclose(file);
+           }));
+
+    report("read", shape, measure(counter, repeats, minSeconds, [&] {
+               FILE*   file = fopen(path, "rb");
+               WavFile wav(counting);
+               wav.read(file);
+               fclose(file);
+           }));
+
+    report("read/fingerprint", shape, measure(counter, repeats, minSeconds, [&] {
+               FILE*          file = fopen(path, "rb");
+               WavFile        wav(counting);
+               WavFingerprint fingerprint;
+               wav.read(file, fingerprint);
+               fclose(file);
+           }));
+
+    WavFile wav(counting);
+    FILE*   file = fopen(path, "rb");
+    wav.read(file);
+    fclose(file);
+
+    report("fingerprint", shape, measure(counter, repeats, minSeconds, [&] {
+               WavFingerprint fingerprint = wav.fingerprint();
+               (void)fingerprint;
+           }));
+
+    // Interleaved and mono only hand back Data.data, there is nothing to time
+    const WavChannelLayout layouts[] = {INLINE, SPLIT};
+    const char*            names[]   = {"getRawData/inline", "getRawData/split"};
+    for (int i = 0; i < 2 && shape.channels > 1; i++)
+        report(names[i], shape, measure(counter, repeats, minSeconds, [&] {
+                   wav.freeRawData(wav.getRawData(layouts[i]), layouts[i]);
+               }));
+
+    report("getData", shape, measure(counter, repeats, minSeconds, [&] {
+               WavData<float> data = wav.getData();
+           }));
+
+    report("getOverview", shape, measure(counter, repeats, minSeconds, [&] {
+               WavOverview overview = wav.getOverview();
+           }));
+
+    WavMix stereo = WavMix::downmix(shape.channels, 2);
+    report("getData/downmix", shape, measure(counter, repeats, minSeconds, [&] {
+               WavData<float> data = wav.getData(stereo);
+           }));
+
+    report("getData/resample", shape, measure(counter, repeats, minSeconds, [&] {
+               WavData<float> data = wav.getData(44100);
+           }));
+
+    WavData<float> data = wav.getData();
+    report("setData", shape, measure(counter, repeats, minSeconds, [&] {
+               wav.setData(data);
+           }));
+
+    report("write", shape, measure(counter, repeats, minSeconds, [&] {
+               FILE* file = fopen(out, "wb");
+               wav.write(file);
+               fclose(file);
+           }));
+
+    report("save", shape, measure(counter, repeats, minSeconds, [&] { wav.save(out, data); }));
+
+    remove(path);
+    remove(out);
+}
+
+int main(int argc, char** argv) {
+    bool        quick  = false;
+    const char* filter = "";
+    const char* dir    = "/tmp";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+            dir = argv[++i];
+    }
+
+    struct {
+        uint16_t type, bits;
+    } formats[]               = {{PCM, 8}, {PCM, 16}, {PCM, 24}, {PCM, 32}, {FLOAT, 32}};
+    uint16_t    channelList[] = {1, 2, 8, 64};
+    uint32_t    seconds[]     = {1, 60};
+    const char* layouts[]     = {"plain", "chunks", "large-chunk"};
+
+    int    repeats    = quick ? 2 : 5;
+    double minSeconds = quick ? 0.05 : 0.5;
+
+    if (strstr("noData", filter) != nullptr)
+        checkNoData(dir);
+
+    for (auto format : formats)
+        for (uint16_t channels : channelList)
+            for (uint32_t length : seconds)
+                for (const char* layout : layouts) {
+                    // Keep each file under 256 MB of samples
+                    uint32_t frames = length * (quick ? 4800 : 48000);
+                    uint64_t bytes  = (uint64_t)frames * channels * format.bits / 8;
+                    if (bytes > (256u << 20))
+                        frames = (uint32_t)((256u << 20) / (channels * format.bits / 8));
+
+                    Shape shape = {format.type, format.bits, channels, frames, layout};
+
+                    char name[128];
+                    snprintf(name, sizeof(name), "%s%u/%uch/%uf/%s",
+                             format.type == FLOAT ? "float" : "pcm", format.bits, channels,
+                             frames, layout);
+                    if (strstr(name, filter) == nullptr)
+                        continue;
+
+                    run(shape, dir, repeats, minSeconds);
+                }
+
+    return 0;
+}
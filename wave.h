@@ -1,6 +1,15 @@
 #ifndef DRDESTEN_WAV
 #define DRDESTEN_WAV
 
+// fseeko, mmap and 64-bit file offsets under strict -std=c11,
+// include wave.h before other headers for these to take effect
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -9,6 +18,21 @@
 #include <string.h>
 #include <math.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(WAV_NO_SIMD) && defined(__SSE2__)
+#define WAV_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(WAV_SSE2) && defined(__GNUC__) && defined(__x86_64__)
+#define WAV_AVX2
+#define WAV_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,11 +42,13 @@ typedef enum {
     WAV_INVALID_DESCRIPTOR,
     WAV_NO_FORMAT,
     WAV_NO_DATA,
+    WAV_IO_ERROR,
 } WavError;
 
 typedef enum {
     WAV_PCM = 1,
     WAV_FLOAT = 3,
+    WAV_EXTENSIBLE = 0xFFFE,
 } WavFormatType;
 
 typedef enum {
@@ -31,29 +57,41 @@ typedef enum {
     WAV_CHANNEL_SPLIT,
 } WavChannelLayout;
 
+typedef struct WavDescriptorChunk {
+	uint8_t  RIFF[4];
+	uint32_t fileSize;
+	uint8_t  WAVE[4];
+} WavDescriptorChunk;
+
+typedef struct WavFormatChunk {
+	uint8_t  FMT[4];
+	uint32_t formatSize;
+	uint16_t formatType;
+	uint16_t channels;
+	uint32_t sampleRate;
+	uint32_t byteRate;
+	uint16_t blockSize;
+	uint16_t bitsPerSample;
+} WavFormatChunk;
+
+typedef struct WavDataChunk {
+	uint8_t  DATA[4];
+	uint64_t dataSize;
+	void*    data;
+} WavDataChunk;
+
+// 64-bit sizes of RF64/BW64 files, from the ds64 chunk. Zero for RIFF.
+typedef struct WavDs64Chunk {
+	uint64_t riffSize;
+	uint64_t dataSize;
+	uint64_t sampleCount;
+} WavDs64Chunk;
+
 typedef struct {
-	struct WavDescriptorChunk {
-		uint8_t  RIFF[4];
-		uint32_t fileSize;
-		uint8_t  WAVE[4];
-	} Descriptor;
-
-	struct WavFormatChunk {
-		uint8_t  FMT[4];
-		uint32_t formatSize;
-		uint16_t formatType;
-		uint16_t channels;
-		uint32_t sampleRate;
-		uint32_t byteRate;
-		uint16_t blockSize;
-		uint16_t bitsPerSample;
-	} Format;
-
-	struct WavDataChunk {
-		uint8_t  DATA[4];
-		uint32_t dataSize;
-		void*    data;
-	} Data;
+	WavDescriptorChunk Descriptor;
+	WavFormatChunk     Format;
+	WavDataChunk       Data;
+	WavDs64Chunk       Ds64;
 } WavFile;
 
 typedef struct {
@@ -67,8 +105,505 @@ typedef struct {
     WavChunk* data;
 } WavChunks;
 
+typedef struct {
+    void*  base;
+    size_t size;
+} WavMapping;
+
+// Walks the chunks of a buffer in place, see WavFile_parse
+typedef struct {
+    const uint8_t* ptr;
+    const uint8_t* end;
+    WavDs64Chunk   ds64;
+    uint64_t       size; // Full size of the last chunk, chunk.size may be capped
+} WavChunkCursor;
+
+// Memory interface used for every buffer the library hands out.
+// free may be NULL for allocators that release everything at once.
+typedef struct {
+    void* (*alloc)(void* context, size_t size, size_t alignment);
+    void  (*free)(void* context, void* ptr);
+    void*  context;
+} WavAllocator;
+
+// Bump allocator. Allocations are not freed one by one, WavArena_reset drops
+// all of them at once and keeps the blocks around for the next file.
+typedef struct WavArenaBlock {
+    struct WavArenaBlock* next;
+    size_t                size;
+    size_t                used;
+} WavArenaBlock;
+
+typedef struct {
+    WavArenaBlock* blocks; // Blocks in use, newest first
+    WavArenaBlock* last;   // Oldest block in use
+    WavArenaBlock* spare;  // Blocks kept for reuse
+    size_t         blockSize;
+} WavArena;
+
+// Three byte sample, for moving packed 24-bit audio around
+typedef struct {
+    uint8_t bytes[3];
+} WavSample24;
+
+// Eight byte sample, 64-bit data is only 4-byte aligned after the header
+typedef struct {
+    uint8_t bytes[8];
+} WavSample64;
+
+
+#ifdef __cplusplus
+#define WAV_THREAD_LOCAL thread_local
+#else
+#define WAV_THREAD_LOCAL _Thread_local
+#endif
+
+#define WAV_ARENA_HEADER 64 // Block header size, keeps block memory 64-byte aligned
+
+static void* Wav_heapAlloc(void* context, size_t size, size_t alignment) {
+    (void) context;
+    if (alignment <= 16) return malloc(size);
+    void* ptr;
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+}
+static void Wav_heapFree(void* context, void* ptr) {
+    (void) context;
+    free(ptr);
+}
+
+static WavAllocator WavAllocator_heap(void) {
+    WavAllocator allocator = { Wav_heapAlloc, Wav_heapFree, NULL };
+    return allocator;
+}
+
+static void* WavAllocator_alloc(const WavAllocator* allocator, size_t size, size_t alignment) {
+    return allocator->alloc(allocator->context, size, alignment);
+}
+static void WavAllocator_free(const WavAllocator* allocator, void* ptr) {
+    if (allocator->free != NULL && ptr != NULL)
+        allocator->free(allocator->context, ptr);
+}
+static void* WavAllocator_realloc(const WavAllocator* allocator, void* ptr, size_t oldSize, size_t newSize) {
+    if (allocator->alloc == Wav_heapAlloc)
+        return realloc(ptr, newSize);
+
+    void* out = WavAllocator_alloc(allocator, newSize, 16);
+    if (out != NULL && ptr != NULL)
+        memcpy(out, ptr, oldSize < newSize ? oldSize : newSize);
+    WavAllocator_free(allocator, ptr);
+    return out;
+}
+
+static void WavArena_init(WavArena* arena, size_t blockSize) {
+    arena->blocks    = NULL;
+    arena->last      = NULL;
+    arena->spare     = NULL;
+    arena->blockSize = blockSize;
+}
+
+static void* WavArenaBlock_take(WavArenaBlock* block, size_t size, size_t alignment) {
+    uintptr_t base  = (uintptr_t) block + WAV_ARENA_HEADER;
+    uintptr_t start = (base + block->used + alignment - 1) & ~(uintptr_t) (alignment - 1);
+    if (start + size > base + block->size)
+        return NULL;
+    block->used = start + size - base;
+    return (void*) start;
+}
+
+static void* WavArena_alloc(WavArena* arena, size_t size, size_t alignment) {
+    if (arena->blocks != NULL) {
+        void* ptr = WavArenaBlock_take(arena->blocks, size, alignment);
+        if (ptr != NULL) return ptr;
+    }
+
+    // Reuse a spare block that fits, or get a new one
+    size_t          need  = size + alignment;
+    WavArenaBlock** link  = &arena->spare;
+    WavArenaBlock*  block = NULL;
+    while (*link != NULL && (*link)->size < need)
+        link = &(*link)->next;
+    if (*link != NULL) {
+        block = *link;
+        *link = block->next;
+    } else {
+        size_t blockSize = arena->blockSize ? arena->blockSize : 1 << 20;
+        size_t capacity  = need > blockSize ? need : blockSize;
+        void*  memory;
+        if (posix_memalign(&memory, 64, WAV_ARENA_HEADER + capacity) != 0)
+            return NULL;
+        block       = (WavArenaBlock*) memory;
+        block->size = capacity;
+    }
+
+    block->used   = 0;
+    block->next   = arena->blocks;
+    arena->blocks = block;
+    if (arena->last == NULL)
+        arena->last = block;
+    return WavArenaBlock_take(block, size, alignment);
+}
+
+// Drops every allocation in O(1)
+static void WavArena_reset(WavArena* arena) {
+    if (arena->blocks == NULL) return;
+    arena->last->next = arena->spare;
+    arena->spare      = arena->blocks;
+    arena->blocks     = NULL;
+    arena->last       = NULL;
+}
+
+// Returns all blocks to the heap
+static void WavArena_release(WavArena* arena) {
+    WavArena_reset(arena);
+    while (arena->spare != NULL) {
+        WavArenaBlock* next = arena->spare->next;
+        free(arena->spare);
+        arena->spare = next;
+    }
+}
+
+static void* Wav_arenaAlloc(void* context, size_t size, size_t alignment) {
+    return WavArena_alloc((WavArena*) context, size, alignment);
+}
+
+static WavAllocator WavArena_allocator(WavArena* arena) {
+    WavAllocator allocator = { Wav_arenaAlloc, NULL, arena };
+    return allocator;
+}
 
-static WavChunk Wav_readChunk(FILE* file) {
+// Arena of the calling thread, reset it between files to reuse its blocks.
+// Call WavArena_release on it before the thread exits.
+static WavArena* WavArena_thread(void) {
+    static WAV_THREAD_LOCAL WavArena arena;
+    return &arena;
+}
+
+#define WAV_DEINTERLEAVE(type, count)                                                 \
+    for (size_t i = 0; i < frames; i++)                                               \
+        for (uint32_t c = 0; c < (count); c++)                                        \
+            ((type*) dst[c])[offset + i] = ((const type*) in)[i * (count) + c];
+
+#define WAV_DEINTERLEAVE_SCALAR(type)                                                 \
+    switch (channels) {                                                               \
+        case 1:  WAV_DEINTERLEAVE(type, 1); break;                                    \
+        case 2:  WAV_DEINTERLEAVE(type, 2); break;                                    \
+        case 4:  WAV_DEINTERLEAVE(type, 4); break;                                    \
+        case 6:  WAV_DEINTERLEAVE(type, 6); break;                                    \
+        case 8:  WAV_DEINTERLEAVE(type, 8); break;                                    \
+        default: WAV_DEINTERLEAVE(type, channels); break;                             \
+    }
+
+#ifdef WAV_AVX2
+static bool Wav_hasAVX2(void) {
+    static int avx2 = -1;
+    if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+#ifdef WAV_SSE2
+// Each kernel handles whole vectors and returns the frames it processed,
+// the scalar code finishes the remainder.
+static size_t Wav_deinterleaveSSE2(const uint8_t* src, void* const* dst, size_t offset, size_t frames, uint32_t channels, uint32_t bytes) {
+    size_t i = 0;
+
+    if (bytes == 1 && channels == 2) {
+        int8_t* c0 = (int8_t*)dst[0] + offset;
+        int8_t* c1 = (int8_t*)dst[1] + offset;
+        for (; i + 16 <= frames; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+            __m128i la = _mm_srai_epi16(_mm_slli_epi16(a, 8), 8);
+            __m128i lb = _mm_srai_epi16(_mm_slli_epi16(b, 8), 8);
+            _mm_storeu_si128((__m128i*)(c0 + i), _mm_packs_epi16(la, lb));
+            _mm_storeu_si128((__m128i*)(c1 + i),
+                             _mm_packs_epi16(_mm_srai_epi16(a, 8), _mm_srai_epi16(b, 8)));
+        }
+    }
+
+    if (bytes == 2 && channels == 2) {
+        int16_t* c0 = (int16_t*)dst[0] + offset;
+        int16_t* c1 = (int16_t*)dst[1] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 4));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+            __m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            _mm_storeu_si128((__m128i*)(c0 + i), _mm_packs_epi32(la, lb));
+            _mm_storeu_si128((__m128i*)(c1 + i),
+                             _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+        }
+    }
+
+    if (bytes == 2 && channels == 4) {
+        int16_t* c[4];
+        for (int j = 0; j < 4; j++)
+            c[j] = (int16_t*)dst[j] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            const __m128i* s = (const __m128i*)(src + i * 8);
+            __m128i r0 = _mm_loadu_si128(s + 0), r1 = _mm_loadu_si128(s + 1);
+            __m128i r2 = _mm_loadu_si128(s + 2), r3 = _mm_loadu_si128(s + 3);
+            __m128i t0 = _mm_unpacklo_epi16(r0, r1), t1 = _mm_unpackhi_epi16(r0, r1);
+            __m128i t2 = _mm_unpacklo_epi16(r2, r3), t3 = _mm_unpackhi_epi16(r2, r3);
+            __m128i u0 = _mm_unpacklo_epi16(t0, t1), u1 = _mm_unpackhi_epi16(t0, t1);
+            __m128i v0 = _mm_unpacklo_epi16(t2, t3), v1 = _mm_unpackhi_epi16(t2, t3);
+            _mm_storeu_si128((__m128i*)(c[0] + i), _mm_unpacklo_epi64(u0, v0));
+            _mm_storeu_si128((__m128i*)(c[1] + i), _mm_unpackhi_epi64(u0, v0));
+            _mm_storeu_si128((__m128i*)(c[2] + i), _mm_unpacklo_epi64(u1, v1));
+            _mm_storeu_si128((__m128i*)(c[3] + i), _mm_unpackhi_epi64(u1, v1));
+        }
+    }
+
+    if (bytes == 2 && channels == 8) {
+        int16_t* c[8];
+        for (int j = 0; j < 8; j++)
+            c[j] = (int16_t*)dst[j] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            const __m128i* s = (const __m128i*)(src + i * 16);
+            __m128i r[8], t[8], u[8];
+            for (int j = 0; j < 8; j++)
+                r[j] = _mm_loadu_si128(s + j);
+            for (int j = 0; j < 8; j += 2) {
+                t[j]     = _mm_unpacklo_epi16(r[j], r[j + 1]);
+                t[j + 1] = _mm_unpackhi_epi16(r[j], r[j + 1]);
+            }
+            for (int j = 0; j < 8; j += 4) {
+                u[j]     = _mm_unpacklo_epi32(t[j], t[j + 2]);
+                u[j + 1] = _mm_unpackhi_epi32(t[j], t[j + 2]);
+                u[j + 2] = _mm_unpacklo_epi32(t[j + 1], t[j + 3]);
+                u[j + 3] = _mm_unpackhi_epi32(t[j + 1], t[j + 3]);
+            }
+            for (int j = 0; j < 4; j++) {
+                _mm_storeu_si128((__m128i*)(c[j * 2] + i), _mm_unpacklo_epi64(u[j], u[j + 4]));
+                _mm_storeu_si128((__m128i*)(c[j * 2 + 1] + i), _mm_unpackhi_epi64(u[j], u[j + 4]));
+            }
+        }
+    }
+
+    if (bytes == 4 && channels == 2) {
+        float* c0 = (float*)dst[0] + offset;
+        float* c1 = (float*)dst[1] + offset;
+        for (; i + 4 <= frames; i += 4) {
+            const float* s = (const float*)(src + i * 8);
+            __m128       a = _mm_loadu_ps(s), b = _mm_loadu_ps(s + 4);
+            _mm_storeu_ps(c0 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(c1 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+
+    if (bytes == 4 && channels == 4) {
+        float* c[4];
+        for (int j = 0; j < 4; j++)
+            c[j] = (float*)dst[j] + offset;
+        for (; i + 4 <= frames; i += 4) {
+            const float* s  = (const float*)(src + i * 16);
+            __m128       r0 = _mm_loadu_ps(s), r1 = _mm_loadu_ps(s + 4);
+            __m128       r2 = _mm_loadu_ps(s + 8), r3 = _mm_loadu_ps(s + 12);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(c[0] + i, r0);
+            _mm_storeu_ps(c[1] + i, r1);
+            _mm_storeu_ps(c[2] + i, r2);
+            _mm_storeu_ps(c[3] + i, r3);
+        }
+    }
+
+    if (bytes == 4 && channels == 6) {
+        float* c[6];
+        for (int j = 0; j < 6; j++)
+            c[j] = (float*)dst[j] + offset;
+        for (; i + 4 <= frames; i += 4) {
+            const float* s  = (const float*)(src + i * 24);
+            __m128       v0 = _mm_loadu_ps(s), v1 = _mm_loadu_ps(s + 4);
+            __m128       v2 = _mm_loadu_ps(s + 8), v3 = _mm_loadu_ps(s + 12);
+            __m128       v4 = _mm_loadu_ps(s + 16), v5 = _mm_loadu_ps(s + 20);
+            // Channels 0-3 of each frame
+            __m128 r0 = v0, r1 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 3, 2));
+            __m128 r2 = v3, r3 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(1, 0, 3, 2));
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            // Channels 4-5 of frames 0, 2 and 1, 3
+            __m128 h0 = _mm_movelh_ps(v1, v4), h1 = _mm_movehl_ps(v5, v2);
+            h0 = _mm_shuffle_ps(h0, h0, _MM_SHUFFLE(3, 1, 2, 0));
+            h1 = _mm_shuffle_ps(h1, h1, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_ps(c[0] + i, r0);
+            _mm_storeu_ps(c[1] + i, r1);
+            _mm_storeu_ps(c[2] + i, r2);
+            _mm_storeu_ps(c[3] + i, r3);
+            _mm_storeu_ps(c[4] + i, _mm_unpacklo_ps(h0, h1));
+            _mm_storeu_ps(c[5] + i, _mm_unpackhi_ps(h0, h1));
+        }
+    }
+
+    if (bytes == 4 && channels == 8) {
+        float* c[8];
+        for (int j = 0; j < 8; j++)
+            c[j] = (float*)dst[j] + offset;
+        for (; i + 4 <= frames; i += 4) {
+            const float* s  = (const float*)(src + i * 32);
+            __m128       l0 = _mm_loadu_ps(s), h0 = _mm_loadu_ps(s + 4);
+            __m128       l1 = _mm_loadu_ps(s + 8), h1 = _mm_loadu_ps(s + 12);
+            __m128       l2 = _mm_loadu_ps(s + 16), h2 = _mm_loadu_ps(s + 20);
+            __m128       l3 = _mm_loadu_ps(s + 24), h3 = _mm_loadu_ps(s + 28);
+            _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+            _MM_TRANSPOSE4_PS(h0, h1, h2, h3);
+            _mm_storeu_ps(c[0] + i, l0);
+            _mm_storeu_ps(c[1] + i, l1);
+            _mm_storeu_ps(c[2] + i, l2);
+            _mm_storeu_ps(c[3] + i, l3);
+            _mm_storeu_ps(c[4] + i, h0);
+            _mm_storeu_ps(c[5] + i, h1);
+            _mm_storeu_ps(c[6] + i, h2);
+            _mm_storeu_ps(c[7] + i, h3);
+        }
+    }
+
+    if (bytes == 8 && channels == 2) {
+        int64_t* c0 = (int64_t*)dst[0] + offset;
+        int64_t* c1 = (int64_t*)dst[1] + offset;
+        for (; i + 2 <= frames; i += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 16));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 16 + 16));
+            _mm_storeu_si128((__m128i*)(c0 + i), _mm_unpacklo_epi64(a, b));
+            _mm_storeu_si128((__m128i*)(c1 + i), _mm_unpackhi_epi64(a, b));
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+#ifdef WAV_AVX2
+WAV_TARGET_AVX2
+static size_t Wav_deinterleaveAVX2(const uint8_t* src, void* const* dst, size_t offset, size_t frames, uint32_t channels, uint32_t bytes) {
+    size_t i = 0;
+
+    if (bytes == 2 && channels == 2) {
+        int16_t* c0 = (int16_t*)dst[0] + offset;
+        int16_t* c1 = (int16_t*)dst[1] + offset;
+        for (; i + 16 <= frames; i += 16) {
+            __m256i a  = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+            __m256i b  = _mm256_loadu_si256((const __m256i*)(src + i * 4 + 32));
+            __m256i la = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+            __m256i lb = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+            __m256i l  = _mm256_packs_epi32(la, lb);
+            __m256i r  = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+            // Packing works per 128-bit lane, restore frame order
+            _mm256_storeu_si256((__m256i*)(c0 + i), _mm256_permute4x64_epi64(l, _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_si256((__m256i*)(c1 + i), _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+    }
+
+    if (bytes == 4 && channels == 2) {
+        float* c0 = (float*)dst[0] + offset;
+        float* c1 = (float*)dst[1] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            const float* s = (const float*)(src + i * 8);
+            __m256       a = _mm256_loadu_ps(s), b = _mm256_loadu_ps(s + 8);
+            __m256d      l = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m256d      r = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm256_storeu_ps(c0 + i, _mm256_castpd_ps(_mm256_permute4x64_pd(l, _MM_SHUFFLE(3, 1, 2, 0))));
+            _mm256_storeu_ps(c1 + i, _mm256_castpd_ps(_mm256_permute4x64_pd(r, _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+    }
+
+    if (bytes == 4 && channels == 4) {
+        float* c[4];
+        for (int j = 0; j < 4; j++)
+            c[j] = (float*)dst[j] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            const float* s  = (const float*)(src + i * 16);
+            __m256       r0 = _mm256_loadu_ps(s), r1 = _mm256_loadu_ps(s + 8);
+            __m256       r2 = _mm256_loadu_ps(s + 16), r3 = _mm256_loadu_ps(s + 24);
+            // Pair frames i and i + 4 in the two lanes, then transpose per lane
+            __m256 a0 = _mm256_permute2f128_ps(r0, r2, 0x20);
+            __m256 a1 = _mm256_permute2f128_ps(r0, r2, 0x31);
+            __m256 a2 = _mm256_permute2f128_ps(r1, r3, 0x20);
+            __m256 a3 = _mm256_permute2f128_ps(r1, r3, 0x31);
+            __m256 t0 = _mm256_unpacklo_ps(a0, a1), t1 = _mm256_unpackhi_ps(a0, a1);
+            __m256 t2 = _mm256_unpacklo_ps(a2, a3), t3 = _mm256_unpackhi_ps(a2, a3);
+            _mm256_storeu_ps(c[0] + i, _mm256_shuffle_ps(t0, t2, 0x44));
+            _mm256_storeu_ps(c[1] + i, _mm256_shuffle_ps(t0, t2, 0xEE));
+            _mm256_storeu_ps(c[2] + i, _mm256_shuffle_ps(t1, t3, 0x44));
+            _mm256_storeu_ps(c[3] + i, _mm256_shuffle_ps(t1, t3, 0xEE));
+        }
+    }
+
+    if (bytes == 4 && channels == 8) {
+        float* c[8];
+        for (int j = 0; j < 8; j++)
+            c[j] = (float*)dst[j] + offset;
+        for (; i + 8 <= frames; i += 8) {
+            const float* s = (const float*)(src + i * 32);
+            __m256       r[8], t[8], u[8];
+            for (int j = 0; j < 8; j++)
+                r[j] = _mm256_loadu_ps(s + j * 8);
+            for (int j = 0; j < 8; j += 2) {
+                t[j]     = _mm256_unpacklo_ps(r[j], r[j + 1]);
+                t[j + 1] = _mm256_unpackhi_ps(r[j], r[j + 1]);
+            }
+            for (int j = 0; j < 8; j += 4) {
+                u[j]     = _mm256_shuffle_ps(t[j], t[j + 2], 0x44);
+                u[j + 1] = _mm256_shuffle_ps(t[j], t[j + 2], 0xEE);
+                u[j + 2] = _mm256_shuffle_ps(t[j + 1], t[j + 3], 0x44);
+                u[j + 3] = _mm256_shuffle_ps(t[j + 1], t[j + 3], 0xEE);
+            }
+            for (int j = 0; j < 4; j++) {
+                _mm256_storeu_ps(c[j] + i, _mm256_permute2f128_ps(u[j], u[j + 4], 0x20));
+                _mm256_storeu_ps(c[j + 4] + i, _mm256_permute2f128_ps(u[j], u[j + 4], 0x31));
+            }
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+// Splits interleaved frames into one buffer per channel,
+// writing them to dst[c][offset] onwards. Samples are bytes wide.
+static void Wav_deinterleave(const void* src, void* const* dst, size_t offset, size_t frames, uint32_t channels, uint32_t bytes) {
+    const uint8_t* in   = (const uint8_t*) src;
+    size_t         done = 0;
+#ifdef WAV_AVX2
+    if (Wav_hasAVX2())
+        done += Wav_deinterleaveAVX2(in, dst, offset, frames, channels, bytes);
+#endif
+#ifdef WAV_SSE2
+    done += Wav_deinterleaveSSE2(in + done * channels * bytes, dst, offset + done, frames - done, channels, bytes);
+#endif
+    in     += done * channels * bytes;
+    offset += done;
+    frames -= done;
+
+    switch (bytes) {
+        case 1: WAV_DEINTERLEAVE_SCALAR(uint8_t);  break;
+        case 2: WAV_DEINTERLEAVE_SCALAR(uint16_t); break;
+        case 3: WAV_DEINTERLEAVE_SCALAR(WavSample24); break;
+        case 4: WAV_DEINTERLEAVE_SCALAR(uint32_t); break;
+        case 8: WAV_DEINTERLEAVE_SCALAR(WavSample64); break;
+    }
+}
+
+#undef WAV_DEINTERLEAVE_SCALAR
+#undef WAV_DEINTERLEAVE
+
+// RIFF, or RF64/BW64 with the sizes in a ds64 chunk
+static bool Wav_isDescriptor(const WavDescriptorChunk* descriptor) {
+    if (memcmp(descriptor->WAVE, "WAVE", 4) != 0)
+        return false;
+    return memcmp(descriptor->RIFF, "RIFF", 4) == 0 || memcmp(descriptor->RIFF, "RF64", 4) == 0 ||
+           memcmp(descriptor->RIFF, "BW64", 4) == 0;
+}
+
+// Chunk size, looking up the data chunk size in ds64 when it does not fit
+static uint64_t Wav_chunkSize(const WavDs64Chunk* ds64, const uint8_t* tag, uint32_t size) {
+    if (size == 0xFFFFFFFF && ds64->dataSize != 0 && memcmp(tag, "data", 4) == 0)
+        return ds64->dataSize;
+    return size;
+}
+
+// Reads the next chunk, with its full 64-bit size in size
+static WavChunk Wav_readChunk(FILE* file, const WavAllocator* allocator, const WavDs64Chunk* ds64, uint64_t* size) {
     // Read Chunk Header
     WavChunk chunk;
     fread(&chunk.tag, 4, 1, file);
@@ -81,8 +616,13 @@ static WavChunk Wav_readChunk(FILE* file) {
     }
 
     // Read Chunk Data
-    chunk.data = malloc(chunk.size);
-    fread(chunk.data, chunk.size, 1, file);
+    *size      = Wav_chunkSize(ds64, chunk.tag, chunk.size);
+    chunk.data = WavAllocator_alloc(allocator, *size, 16);
+    fread(chunk.data, *size, 1, file);
+
+    // Step over the pad byte of odd sized chunks
+    if (*size % 2 != 0)
+        fseeko(file, 1, SEEK_CUR);
 
     return chunk;
 }
@@ -90,28 +630,38 @@ static WavChunk Wav_readChunk(FILE* file) {
 static WavError WavFile_readHeader(WavFile* wavfile, FILE* file) {
     // Read Descriptor
 	fread(&wavfile->Descriptor, sizeof(wavfile->Descriptor), 1, file);
-	if (wavfile->Descriptor.RIFF[0] != 'R' || wavfile->Descriptor.RIFF[1] != 'I' ||
-        wavfile->Descriptor.RIFF[2] != 'F' || wavfile->Descriptor.RIFF[3] != 'F')
-		return WAV_INVALID_DESCRIPTOR;
-	if (wavfile->Descriptor.WAVE[0] != 'W' || wavfile->Descriptor.WAVE[1] != 'A' ||
-        wavfile->Descriptor.WAVE[2] != 'V' || wavfile->Descriptor.WAVE[3] != 'E')
+	if (!Wav_isDescriptor(&wavfile->Descriptor))
 		return WAV_INVALID_DESCRIPTOR;
 
+    // Find the Format, taking the 64-bit sizes from ds64
+    // and skipping padding such as JUNK in front of it
+    memset(&wavfile->Ds64, 0, sizeof(wavfile->Ds64));
+    while (true) {
+        if (fread(&wavfile->Format, 8, 1, file) != 1)
+            return WAV_NO_FORMAT;
+        if (memcmp(wavfile->Format.FMT, "fmt ", 4) == 0)
+            break;
+
+        uint64_t size = wavfile->Format.formatSize + wavfile->Format.formatSize % 2;
+        if (memcmp(wavfile->Format.FMT, "ds64", 4) == 0 && size >= sizeof(wavfile->Ds64)) {
+            fread(&wavfile->Ds64, sizeof(wavfile->Ds64), 1, file);
+            size -= sizeof(wavfile->Ds64);
+        }
+        fseeko(file, size, SEEK_CUR);
+    }
+
     // Read Format
-	fread(&wavfile->Format, sizeof(wavfile->Format), 1, file);
-	if (wavfile->Format.FMT[0] != 'f' || wavfile->Format.FMT[1] != 'm' ||
-        wavfile->Format.FMT[2] != 't' || wavfile->Format.FMT[3] != ' ')
-		return WAV_NO_FORMAT;
+	fread(&wavfile->Format.formatType, sizeof(wavfile->Format) - 8, 1, file);
     
     // Seek forward to the data chunk if format is longer
     if (wavfile->Format.formatSize > 16) {
-        fseek(file, wavfile->Format.formatSize - 16, SEEK_CUR);
+        fseeko(file, wavfile->Format.formatSize - 16, SEEK_CUR);
     }
 
     return WAV_SUCCESS;
 }
 
-static WavError WavFile_readMinimal(WavFile* wavfile, FILE* file) {
+static WavError WavFile_readMinimalWith(WavFile* wavfile, FILE* file, const WavAllocator* allocator) {
     // Read Header
     WavError error = WavFile_readHeader(wavfile, file);
     if (error) return error;
@@ -120,18 +670,17 @@ static WavError WavFile_readMinimal(WavFile* wavfile, FILE* file) {
     // Search file, skipping non-data chunks
 	char tag[4];
 	while (true) {
-		fread(&tag, 4, 1, file);
+		// Seeking clears the end-of-file flag, a short read ends the search
+		if (fread(&tag, 4, 1, file) != 1)
+			return WAV_NO_DATA;
 		if (tag[0] == 'd' && tag[1] == 'a' && tag[2] == 't' && tag[3] == 'a')
 			break; // Data chunk found
 
 		// Skip chunk
 		uint32_t size;
-		fread(&size, 4, 1, file);
-		fseek(file, size, SEEK_CUR);
-
-        // Exit when reaching end of file
-		if (feof(file))
+		if (fread(&size, 4, 1, file) != 1)
 			return WAV_NO_DATA;
+		fseeko(file, (uint64_t) size + size % 2, SEEK_CUR);
 	}
 
 	// Set "data" tag
@@ -141,17 +690,24 @@ static WavError WavFile_readMinimal(WavFile* wavfile, FILE* file) {
 	wavfile->Data.DATA[3] = tag[3];
 
     // Read Data chunk size
-	fread(&wavfile->Data.dataSize, sizeof(wavfile->Data.dataSize), 1, file);
+	uint32_t size;
+	fread(&size, sizeof(size), 1, file);
+	wavfile->Data.dataSize = Wav_chunkSize(&wavfile->Ds64, wavfile->Data.DATA, size);
 
 	// Read the Data
-	wavfile->Data.data = malloc(wavfile->Data.dataSize);
+	wavfile->Data.data = WavAllocator_alloc(allocator, wavfile->Data.dataSize, 16);
 	fread(wavfile->Data.data, wavfile->Data.dataSize, 1, file);
 
     return WAV_SUCCESS;
 }
 
+static WavError WavFile_readMinimal(WavFile* wavfile, FILE* file) {
+    WavAllocator heap = WavAllocator_heap();
+    return WavFile_readMinimalWith(wavfile, file, &heap);
+}
 
-static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
+
+static WavError WavFile_readWith(WavFile* wavfile, WavChunks* chunks, FILE* file, const WavAllocator* allocator) {
     // Read Header
     WavError error = WavFile_readHeader(wavfile, file);
     if (error) return error;
@@ -159,14 +715,15 @@ static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
     // Prepare dynamic array and allocate a generous initial capacity
     uint32_t chunksCapacity = 32;
     chunks->length          = 0;
-    chunks->data            = (WavChunk*) malloc(sizeof(WavChunk) * chunksCapacity);
+    chunks->data            = (WavChunk*) WavAllocator_alloc(allocator, sizeof(WavChunk) * chunksCapacity, 16);
 
 	// Read Chunks
     bool foundData = false;
 	while (true) {
 
         // Read Chunk and check for eof or error
-        WavChunk chunk = Wav_readChunk(file);
+        uint64_t size;
+        WavChunk chunk = Wav_readChunk(file, allocator, &wavfile->Ds64, &size);
         if (chunk.data == NULL)
             break;
 
@@ -179,7 +736,7 @@ static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
             wavfile->Data.DATA[3] = chunk.tag[3];
 
             // Write size and data
-            wavfile->Data.dataSize = chunk.size;
+            wavfile->Data.dataSize = size;
             wavfile->Data.data = chunk.data; 
 
             foundData = true;
@@ -190,7 +747,7 @@ static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
             if (chunksCapacity <= chunks->length) {
                 // Double Capacity when insufficent
                 chunksCapacity *= 2;
-                chunks->data    = (WavChunk*) reallocarray(chunks->data, chunksCapacity, sizeof(WavChunk));
+                chunks->data    = (WavChunk*) WavAllocator_realloc(allocator, chunks->data, chunksCapacity / 2 * sizeof(WavChunk), chunksCapacity * sizeof(WavChunk));
             }
 
             chunks->data[chunks->length] = chunk;
@@ -199,97 +756,279 @@ static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
 	}
 
     // Resize dynamic array to fit
-    chunks->data = (WavChunk*) reallocarray(chunks->data, chunks->length, sizeof(WavChunk));
+    chunks->data = (WavChunk*) WavAllocator_realloc(allocator, chunks->data, chunksCapacity * sizeof(WavChunk), chunks->length * sizeof(WavChunk));
 
     // Return with the appropiate error code
     return foundData ? WAV_SUCCESS : WAV_NO_DATA;
 }
 
-static void* WavFile_getData(WavFile* wavfile, WavChannelLayout channelLayout) {
-    void* raw      = wavfile->Data.data;
-    int   channels = wavfile->Format.channels;
-    int   bits     = wavfile->Format.bitsPerSample;
-    int   samples  = wavfile->Data.dataSize / wavfile->Format.blockSize;
+static WavError WavFile_read(WavFile* wavfile, WavChunks* chunks, FILE* file) {
+    WavAllocator heap = WavAllocator_heap();
+    return WavFile_readWith(wavfile, chunks, file, &heap);
+}
 
-    if (channels <= 1)
-        return raw;
+// Bounds-checked header of a file in memory, leaving ptr at the first
+// chunk after the format
+static WavError Wav_parseHeader(WavFile* wavfile, const uint8_t** ptr, const uint8_t* end) {
+    // Read Descriptor
+    if ((size_t) (end - *ptr) < sizeof(wavfile->Descriptor))
+        return WAV_INVALID_DESCRIPTOR;
+    memcpy(&wavfile->Descriptor, *ptr, sizeof(wavfile->Descriptor));
+    *ptr += sizeof(wavfile->Descriptor);
+	if (!Wav_isDescriptor(&wavfile->Descriptor))
+		return WAV_INVALID_DESCRIPTOR;
 
-    if (channelLayout == WAV_CHANNEL_INTERLIEVED)
-        return raw;
+    // Find the Format, taking the 64-bit sizes from ds64
+    // and skipping padding such as JUNK in front of it
+    memset(&wavfile->Ds64, 0, sizeof(wavfile->Ds64));
+    while (true) {
+        if ((size_t) (end - *ptr) < sizeof(wavfile->Format))
+            return WAV_NO_FORMAT;
+        memcpy(&wavfile->Format, *ptr, sizeof(wavfile->Format));
+        if (memcmp(wavfile->Format.FMT, "fmt ", 4) == 0)
+            break;
+
+        *ptr += 8;
+        if (wavfile->Format.formatSize > (size_t) (end - *ptr))
+            return WAV_NO_FORMAT;
+        if (memcmp(wavfile->Format.FMT, "ds64", 4) == 0 && wavfile->Format.formatSize >= sizeof(wavfile->Ds64))
+            memcpy(&wavfile->Ds64, *ptr, sizeof(wavfile->Ds64));
+        *ptr += wavfile->Format.formatSize;
+        if (wavfile->Format.formatSize % 2 != 0 && *ptr < end)
+            (*ptr)++; // Pad byte
+    }
+    *ptr += sizeof(wavfile->Format);
 
-    if (bits == 8) {
-        int8_t*  data        = (int8_t*)  malloc(samples * channels * sizeof(int8_t));
-        int8_t** channelData = (int8_t**) malloc(channels * sizeof(int8_t*));
+    // Skip forward to the next chunk if format is longer
+    if (wavfile->Format.formatSize > 16) {
+        size_t extension = wavfile->Format.formatSize - 16;
+        *ptr += extension < (size_t) (end - *ptr) ? extension : (size_t) (end - *ptr);
+    }
 
-        for (int i = 0; i < channels; i++)
-            channelData[i] = data + i * samples;
+    return WAV_SUCCESS;
+}
 
-        for (int i = 0; i < samples; i++)
-            for (int j = 0; j < channels; j++)
-                channelData[j][i] = ((int8_t*) raw)[i * channels + j];
+// Fills in the next chunk, with data pointing into the buffer
+static bool WavChunkCursor_next(WavChunkCursor* cursor, WavChunk* chunk) {
+    if (cursor->ptr == NULL || (size_t) (cursor->end - cursor->ptr) < 8)
+        return false;
+    memcpy(&chunk->tag, cursor->ptr, 4);
+    memcpy(&chunk->size, cursor->ptr + 4, 4);
+    cursor->ptr += 8;
 
-        if (channelLayout == WAV_CHANNEL_INLINE)
-            return data;
-        if (channelLayout == WAV_CHANNEL_SPLIT)
-            return channelData;
-        return NULL;
+    // Clamp chunks cut off by the end of the buffer
+    cursor->size = Wav_chunkSize(&cursor->ds64, chunk->tag, chunk->size);
+    if (cursor->size > (size_t) (cursor->end - cursor->ptr))
+        cursor->size = cursor->end - cursor->ptr;
+    if (cursor->size < chunk->size)
+        chunk->size = (uint32_t) cursor->size;
+
+    // Odd sized chunks are followed by a pad byte
+    chunk->data  = (void*) cursor->ptr;
+    cursor->ptr += cursor->size;
+    if (cursor->size % 2 != 0 && cursor->ptr < cursor->end)
+        cursor->ptr++;
+    return true;
+}
+
+// Parses a file held in memory without allocating or copying. Data.data
+// points into buf, which must outlive wavfile. chunks is left at the first
+// chunk after the format, data included, for WavChunkCursor_next.
+static WavError WavFile_parse(WavFile* wavfile, WavChunkCursor* chunks, const void* buf, size_t len) {
+    memset(chunks, 0, sizeof(*chunks));
+
+    const uint8_t* ptr   = (const uint8_t*) buf;
+    const uint8_t* end   = ptr + len;
+    WavError       error = Wav_parseHeader(wavfile, &ptr, end);
+    if (error) return error;
+
+    WavChunkCursor start = {ptr, end, wavfile->Ds64, 0};
+    WavChunkCursor cursor = start;
+    WavChunk       chunk;
+    *chunks = start;
+    while (WavChunkCursor_next(&cursor, &chunk)) {
+        if (memcmp(chunk.tag, "data", 4) == 0) {
+            memcpy(wavfile->Data.DATA, chunk.tag, 4);
+            wavfile->Data.dataSize = cursor.size;
+            wavfile->Data.data     = chunk.data;
+            return WAV_SUCCESS;
+        }
     }
-    if (bits == 16) {
-        int16_t*  data        = (int16_t*)  malloc(samples * channels * sizeof(int16_t));
-        int16_t** channelData = (int16_t**) malloc(channels * sizeof(int16_t*));
+    return WAV_NO_DATA;
+}
 
-        for (int i = 0; i < channels; i++)
-            channelData[i] = data + i * samples;
+// Maps the file at path instead of reading it.
+// Data and all chunks point straight into the (copy-on-write) mapping,
+// release it with WavMapping_unmap instead of freeing them. Only the chunk
+// array comes from allocator, release it with WavChunks_release.
+// The mapping is already released when the header fails to parse.
+static WavError WavFile_mapWith(WavFile* wavfile, WavChunks* chunks, WavMapping* mapping, const char* path, const WavAllocator* allocator) {
+    mapping->base  = NULL;
+    mapping->size  = 0;
+    chunks->length = 0;
+    chunks->data   = NULL;
 
-        for (int i = 0; i < samples; i++)
-            for (int j = 0; j < channels; j++)
-                channelData[j][i] = ((int16_t*) raw)[i * channels + j];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return WAV_IO_ERROR;
 
-        if (channelLayout == WAV_CHANNEL_INLINE)
-            return data;
-        if (channelLayout == WAV_CHANNEL_SPLIT)
-            return channelData;
-        return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return WAV_IO_ERROR;
     }
-    if (bits == 32) {
-        int32_t*  data        = (int32_t*)  malloc(samples * channels * sizeof(int32_t));
-        int32_t** channelData = (int32_t**) malloc(channels * sizeof(int32_t*));
 
-        for (int i = 0; i < channels; i++)
-            channelData[i] = data + i * samples;
+    void* base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return WAV_IO_ERROR;
 
-        for (int i = 0; i < samples; i++)
-            for (int j = 0; j < channels; j++)
-                channelData[j][i] = ((int32_t*) raw)[i * channels + j];
+    mapping->base = base;
+    mapping->size = info.st_size;
 
-        if (channelLayout == WAV_CHANNEL_INLINE)
-            return data;
-        if (channelLayout == WAV_CHANNEL_SPLIT)
-            return channelData;
-        return NULL;
+    const uint8_t* ptr   = (const uint8_t*) base;
+    const uint8_t* end   = ptr + mapping->size;
+    WavError       error = Wav_parseHeader(wavfile, &ptr, end);
+    if (error) {
+        munmap(mapping->base, mapping->size);
+        mapping->base = NULL;
+        mapping->size = 0;
+        return error;
     }
-    if (bits == 64) {
-        int64_t*  data        = (int64_t*)  malloc(samples * channels * sizeof(int64_t));
-        int64_t** channelData = (int64_t**) malloc(channels * sizeof(int64_t*));
 
-        for (int i = 0; i < channels; i++)
-            channelData[i] = data + i * samples;
+    // Prepare dynamic array and allocate a generous initial capacity
+    uint32_t chunksCapacity = 32;
+    chunks->data            = (WavChunk*) WavAllocator_alloc(allocator, sizeof(WavChunk) * chunksCapacity, 16);
 
-        for (int i = 0; i < samples; i++)
-            for (int j = 0; j < channels; j++)
-                channelData[j][i] = ((int64_t*) raw)[i * channels + j];
+    // Point chunks into the mapping
+    bool           foundData = false;
+    WavChunkCursor cursor    = {ptr, end, wavfile->Ds64, 0};
+    WavChunk       chunk;
+    while (WavChunkCursor_next(&cursor, &chunk)) {
+        // (only the first) Data chunk is handled separately
+		if (!foundData && chunk.tag[0] == 'd' && chunk.tag[1] == 'a' && chunk.tag[2] == 't' && chunk.tag[3] == 'a') {
+            memcpy(wavfile->Data.DATA, chunk.tag, 4);
+            wavfile->Data.dataSize = cursor.size;
+            wavfile->Data.data     = chunk.data;
+            foundData = true;
 
-        if (channelLayout == WAV_CHANNEL_INLINE)
-            return data;
-        if (channelLayout == WAV_CHANNEL_SPLIT)
-            return channelData;
-        return NULL;
+        // Handle other tags
+        } else {
+            // Reallocate dynamic array
+            if (chunksCapacity <= chunks->length) {
+                // Double Capacity when insufficent
+                chunksCapacity *= 2;
+                chunks->data    = (WavChunk*) WavAllocator_realloc(allocator, chunks->data, chunksCapacity / 2 * sizeof(WavChunk), chunksCapacity * sizeof(WavChunk));
+            }
+
+            chunks->data[chunks->length] = chunk;
+            chunks->length++;
+        }
     }
 
+    // Resize dynamic array to fit
+    chunks->data = (WavChunk*) WavAllocator_realloc(allocator, chunks->data, chunksCapacity * sizeof(WavChunk), chunks->length * sizeof(WavChunk));
+
+    // Return with the appropiate error code
+    return foundData ? WAV_SUCCESS : WAV_NO_DATA;
+}
+
+static WavError WavFile_map(WavFile* wavfile, WavChunks* chunks, WavMapping* mapping, const char* path) {
+    WavAllocator heap = WavAllocator_heap();
+    return WavFile_mapWith(wavfile, chunks, mapping, path, &heap);
+}
+
+static void WavMapping_unmap(WavMapping* mapping) {
+    if (mapping->base != NULL)
+        munmap(mapping->base, mapping->size);
+    mapping->base = NULL;
+    mapping->size = 0;
+}
+
+static void* WavFile_getDataWith(WavFile* wavfile, WavChannelLayout channelLayout, const WavAllocator* allocator) {
+    void*    raw      = wavfile->Data.data;
+    uint32_t channels = wavfile->Format.channels;
+    uint32_t bits     = wavfile->Format.bitsPerSample;
+    size_t   samples  = wavfile->Data.dataSize / wavfile->Format.blockSize;
+
+    if (channels <= 1)
+        return raw;
+
+    if (channelLayout == WAV_CHANNEL_INTERLIEVED)
+        return raw;
+
     // Unsupported bit depth
+    if (!(bits == 8 || bits == 16 || bits == 24 || bits == 32 || bits == 64))
+        return NULL;
+
+    uint32_t  bytes       = bits / 8;
+    uint8_t*  data        = (uint8_t*)  WavAllocator_alloc(allocator, samples * channels * bytes, 64);
+    uint8_t** channelData = (uint8_t**) WavAllocator_alloc(allocator, channels * sizeof(uint8_t*), 16);
+    if (data == NULL || channelData == NULL) {
+        WavAllocator_free(allocator, channelData);
+        WavAllocator_free(allocator, data);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < channels; i++)
+        channelData[i] = data + i * samples * bytes;
+
+    Wav_deinterleave(raw, (void* const*) channelData, 0, samples, channels, bytes);
+
+    if (channelLayout == WAV_CHANNEL_INLINE) {
+        WavAllocator_free(allocator, channelData);
+        return data;
+    }
+    if (channelLayout == WAV_CHANNEL_SPLIT)
+        return channelData;
+
+    WavAllocator_free(allocator, channelData);
+    WavAllocator_free(allocator, data);
     return NULL;
 }
 
+static void* WavFile_getData(WavFile* wavfile, WavChannelLayout channelLayout) {
+    WavAllocator heap = WavAllocator_heap();
+    return WavFile_getDataWith(wavfile, channelLayout, &heap);
+}
+
+// Releases a buffer returned by WavFile_getData(With) with the same layout.
+// Interleaved and mono results are Data.data itself and stay.
+static void WavFile_freeDataWith(WavFile* wavfile, void* raw, WavChannelLayout channelLayout, const WavAllocator* allocator) {
+    if (raw == NULL || raw == wavfile->Data.data || wavfile->Format.channels <= 1)
+        return;
+    if (channelLayout == WAV_CHANNEL_SPLIT)
+        WavAllocator_free(allocator, ((void**) raw)[0]); // The channels follow the first
+    if (channelLayout == WAV_CHANNEL_INLINE || channelLayout == WAV_CHANNEL_SPLIT)
+        WavAllocator_free(allocator, raw);
+}
+
+static void WavFile_freeData(WavFile* wavfile, void* raw, WavChannelLayout channelLayout) {
+    WavAllocator heap = WavAllocator_heap();
+    WavFile_freeDataWith(wavfile, raw, channelLayout, &heap);
+}
+
+// Releases the data read by WavFile_read(Minimal)With
+static void WavFile_free(WavFile* wavfile, const WavAllocator* allocator) {
+    WavAllocator_free(allocator, wavfile->Data.data);
+    wavfile->Data.data = NULL;
+}
+
+// Releases the chunks read by WavFile_readWith
+static void WavChunks_free(WavChunks* chunks, const WavAllocator* allocator) {
+    for (size_t i = 0; i < chunks->length; i++)
+        WavAllocator_free(allocator, chunks->data[i].data);
+    WavAllocator_free(allocator, chunks->data);
+    chunks->length = 0;
+    chunks->data   = NULL;
+}
+
+// Releases only the chunk array, for chunks from WavFile_map(With)
+// whose data points into the mapping
+static void WavChunks_release(WavChunks* chunks, const WavAllocator* allocator) {
+    WavAllocator_free(allocator, chunks->data);
+    chunks->length = 0;
+    chunks->data   = NULL;
+}
+
 static void WavFile_print(WavFile* wavfile) {
 	printf("RIFF:         '%.4s'\n", wavfile->Descriptor.RIFF);
 	printf("FileSize:      %d\n",    wavfile->Descriptor.fileSize);
@@ -303,7 +1042,7 @@ static void WavFile_print(WavFile* wavfile) {
 	printf("BlockSize:     %d\n",    wavfile->Format.blockSize);
 	printf("BitsPerSample: %d\n",    wavfile->Format.bitsPerSample);
 	printf("DATA:         '%.4s'\n", wavfile->Data.DATA);
-	printf("DataSize:      %d\n",    wavfile->Data.dataSize);
+	printf("DataSize:      %llu\n",  (unsigned long long) wavfile->Data.dataSize);
 }
 
 static void WavChunk_print(WavChunk* chunk) {
@@ -9,22 +9,166 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if !defined(WAV_NO_SIMD) && defined(__SSE2__)
+#define WAV_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(WAV_SSE2) && defined(__GNUC__) && defined(__x86_64__)
+#define WAV_AVX2
+#define WAV_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+enum WavStage : uint8_t {
+    STAGE_HEADER, // Descriptor, format and anything in front of it
+    STAGE_SEEK,   // Looking for the data chunk
+    STAGE_READ,   // Reading chunk payloads
+    STAGE_DECODE, // Conversion to planar float or another channel layout
+    STAGE_ENCODE, // Conversion from planar float
+    STAGE_WRITE,
+    STAGE_COUNT,
+};
+
+// Counters for the hot paths, only updated when compiled with WAV_STATS.
+// Updates are relaxed atomics on separate cache lines, so one instance can
+// collect from any number of threads. Each thread reports to global()
+// unless a Scope points it at another instance.
+struct WavStats {
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> value{0};
+
+        void     add(uint64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+        void     reset() { value.store(0, std::memory_order_relaxed); }
+    };
+
+    Counter bytesRead;
+    Counter bytesWritten;
+    Counter ioCalls; // Reads, writes and seeks
+    Counter allocations;
+    Counter allocationBytes;
+    Counter chunksSkipped;
+    Counter nanoseconds[STAGE_COUNT];
+
+    static WavStats& global() {
+        static WavStats stats;
+        return stats;
+    }
+
+    static WavStats*& current() {
+        static thread_local WavStats* stats = &global();
+        return stats;
+    }
+
+    // Sends the calling thread's counts to stats until destroyed
+    struct Scope {
+        WavStats* previous;
+
+        explicit Scope(WavStats& stats) : previous(current()) { current() = &stats; }
+        Scope(const Scope& other) = delete;
+        ~Scope() { current() = previous; }
+    };
+
+    // Adds the time until destroyed to a stage
+    struct Timer {
+        WavStage                              stage;
+        std::chrono::steady_clock::time_point start;
+
+        explicit Timer(WavStage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            current()->nanoseconds[stage].add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    };
+
+    void reset() {
+        bytesRead.reset();
+        bytesWritten.reset();
+        ioCalls.reset();
+        allocations.reset();
+        allocationBytes.reset();
+        chunksSkipped.reset();
+        for (Counter& counter : nanoseconds)
+            counter.reset();
+    }
+
+    void print() const {
+        static const char* stages[STAGE_COUNT] = {"Header:", "Seek:",   "Read:",
+                                                  "Decode:", "Encode:", "Write:"};
+        printf("BytesRead:     %llu\n", (unsigned long long)bytesRead.get());
+        printf("BytesWritten:  %llu\n", (unsigned long long)bytesWritten.get());
+        printf("IOCalls:       %llu\n", (unsigned long long)ioCalls.get());
+        printf("Allocations:   %llu (%llu bytes)\n", (unsigned long long)allocations.get(),
+               (unsigned long long)allocationBytes.get());
+        printf("ChunksSkipped: %llu\n", (unsigned long long)chunksSkipped.get());
+        for (int i = 0; i < STAGE_COUNT; i++)
+            printf("%-15s%llu ns\n", stages[i], (unsigned long long)nanoseconds[i].get());
+    }
+};
+
+#ifdef WAV_STATS
+#define WAV_COUNT(counter, n) (WavStats::current()->counter.add(n))
+#define WAV_TIME(stage)       WavStats::Timer wavStageTimer(stage)
+#else
+#define WAV_COUNT(counter, n) ((void)0)
+#define WAV_TIME(stage)       ((void)0)
+#endif
+
+// Return the number of whole items transferred, 1 or 0
 template <typename T>
-void readFile(T* dst, FILE* file) {
-    fread(dst, sizeof(T), 1, file);
+size_t readFile(T* dst, FILE* file) {
+    WAV_COUNT(ioCalls, 1);
+    WAV_COUNT(bytesRead, sizeof(T));
+    return fread(dst, sizeof(T), 1, file);
 }
 template <typename T>
-void readFile(T* dst, size_t size, FILE* file) {
-    fread(dst, size, 1, file);
+size_t readFile(T* dst, size_t size, FILE* file) {
+    WAV_COUNT(ioCalls, 1);
+    WAV_COUNT(bytesRead, size);
+    return fread(dst, size, 1, file);
 }
 
 template <typename T>
-void writeFile(T* dst, FILE* file) {
-    fwrite(dst, sizeof(T), 1, file);
+size_t writeFile(T* dst, FILE* file) {
+    WAV_COUNT(ioCalls, 1);
+    WAV_COUNT(bytesWritten, sizeof(T));
+    return fwrite(dst, sizeof(T), 1, file);
 }
 template <typename T>
-void writeFile(T* dst, size_t size, FILE* file) {
-    fwrite(dst, size, 1, file);
+size_t writeFile(T* dst, size_t size, FILE* file) {
+    WAV_COUNT(ioCalls, 1);
+    WAV_COUNT(bytesWritten, size);
+    return fwrite(dst, size, 1, file);
+}
+
+// Seeks past a chunk payload
+inline void skipFile(FILE* file, uint64_t size) {
+    WAV_COUNT(ioCalls, 1);
+    WAV_COUNT(chunksSkipped, 1);
+    fseeko(file, size, SEEK_CUR);
 }
 
 enum WavError : uint8_t {
@@ -32,11 +176,13 @@ enum WavError : uint8_t {
     INVALID_DESCRIPTOR,
     NO_FORMAT,
     NO_DATA,
+    IO_ERROR,
 };
 
-enum WavFormatType : uint8_t {
-    PCM   = 1,
-    FLOAT = 3,
+enum WavFormatType : uint16_t {
+    PCM        = 1,
+    FLOAT      = 3,
+    EXTENSIBLE = 0xFFFE,
 };
 
 enum WavChannelLayout : uint8_t {
@@ -45,421 +191,3794 @@ enum WavChannelLayout : uint8_t {
     SPLIT,
 };
 
-template <typename T>
-struct WavData {
-    uint32_t channels;
-    uint32_t samples;
-    T**      data;
+// Memory interface used for every buffer the library hands out.
+// Plain function pointers, so the same struct can be filled in from C.
+// free may be null for allocators that release everything at once.
+struct WavAllocator {
+    void* (*alloc)(void* context, size_t size, size_t alignment);
+    void (*free)(void* context, void* ptr);
+    void* context;
 
-    void free() {
-        for (uint32_t i = 0; i < channels; i++)
-            ::free(data[i]);
-        ::free(data);
+    void* allocate(size_t size, size_t alignment = 16) const {
+        WAV_COUNT(allocations, 1);
+        WAV_COUNT(allocationBytes, size);
+        return alloc(context, size, alignment);
+    }
+    void release(void* ptr) const {
+        if (free != nullptr && ptr != nullptr)
+            free(context, ptr);
+    }
+    void* reallocate(void* ptr, size_t oldSize, size_t newSize) const {
+        if (alloc == heapAlloc) {
+            WAV_COUNT(allocations, 1);
+            WAV_COUNT(allocationBytes, newSize);
+            return realloc(ptr, newSize);
+        }
+
+        void* out = allocate(newSize);
+        if (out != nullptr && ptr != nullptr)
+            memcpy(out, ptr, oldSize < newSize ? oldSize : newSize);
+        release(ptr);
+        return out;
+    }
+
+    static WavAllocator heap() { return {heapAlloc, heapFree, nullptr}; }
+
+    static void* heapAlloc(void*, size_t size, size_t alignment) {
+        if (alignment <= 16)
+            return malloc(size);
+        void* ptr;
+        return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
     }
+    static void heapFree(void*, void* ptr) { ::free(ptr); }
 };
 
-struct WavFile {
-    static constexpr const uint8_t RIFF[4] = {'R', 'I', 'F', 'F'};
-    static constexpr const uint8_t WAVE[4] = {'W', 'A', 'V', 'E'};
-    static constexpr const uint8_t fmt[4]  = {'f', 'm', 't', ' '};
+// Bump allocator. Allocations are not freed one by one, reset() drops all
+// of them at once and keeps the blocks around for the next file.
+struct WavArena {
+    explicit WavArena(size_t blockSize = 1 << 20)
+        : blocks(nullptr), last(nullptr), spare(nullptr), blockSize(blockSize) {}
+    WavArena(const WavArena& other)            = delete;
+    WavArena& operator=(const WavArena& other) = delete;
+    ~WavArena() { release(); }
 
-  public:
-    struct Descriptor {
-        uint8_t  RIFF[4];
-        uint32_t fileSize;
-        uint8_t  WAVE[4];
-    } Descriptor;
+    void* allocate(size_t size, size_t alignment = 16) {
+        if (blocks != nullptr) {
+            void* ptr = blocks->take(size, alignment);
+            if (ptr != nullptr)
+                return ptr;
+        }
 
-    struct Format {
-        uint8_t  FMT[4];
-        uint32_t formatSize;
-        uint16_t formatType;
-        uint16_t channels;
-        uint32_t sampleRate;
-        uint32_t byteRate;
-        uint16_t blockSize;
-        uint16_t bitsPerSample;
-    } Format;
+        // Reuse a spare block that fits, or get a new one
+        size_t  need  = size + alignment;
+        Block** link  = &spare;
+        Block*  block = nullptr;
+        while (*link != nullptr && (*link)->size < need)
+            link = &(*link)->next;
+        if (*link != nullptr) {
+            block = *link;
+            *link = block->next;
+        } else {
+            size_t capacity = need > blockSize ? need : blockSize;
+            void*  memory;
+            if (posix_memalign(&memory, 64, sizeof(Block) + capacity) != 0)
+                return nullptr;
+            block       = (Block*)memory;
+            block->size = capacity;
+        }
 
-    struct Data {
-        uint8_t  DATA[4];
-        uint32_t size;
-        void*    data;
-    } Data;
+        block->used = 0;
+        block->next = blocks;
+        blocks      = block;
+        if (last == nullptr)
+            last = block;
+        return block->take(size, alignment);
+    }
 
-    struct Chunk {
-        uint8_t  tag[4];
-        uint32_t size;
-        void*    data;
-        void     print() { printf("[Chunk '%.4s', Size %u bytes]\n", tag, size); }
-    };
+    // Drops every allocation in O(1)
+    void reset() {
+        if (blocks == nullptr)
+            return;
+        last->next = spare;
+        spare      = blocks;
+        blocks     = nullptr;
+        last       = nullptr;
+    }
 
-    struct Chunks {
-        uint32_t length;
-        Chunk*   chunks;
+    // Returns all blocks to the heap
+    void release() {
+        reset();
+        while (spare != nullptr) {
+            Block* next = spare->next;
+            ::free(spare);
+            spare = next;
+        }
+    }
 
-        void print() {
-            for (int64_t i = 0; i < length; i++)
-                chunks[i].print();
+    WavAllocator allocator() { return {arenaAlloc, nullptr, this}; }
+
+    // Arena of the calling thread, reset it between files to reuse its blocks
+    static WavArena& thread() {
+        static thread_local WavArena arena;
+        return arena;
+    }
+
+  private:
+    struct alignas(64) Block {
+        Block* next;
+        size_t size;
+        size_t used;
+
+        void* take(size_t bytes, size_t alignment) {
+            uintptr_t base  = (uintptr_t)(this + 1);
+            uintptr_t start = (base + used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            if (start + bytes > base + size)
+                return nullptr;
+            used = start + bytes - base;
+            return (void*)start;
         }
-    } Chunks;
+    };
 
-    WavFile() {}
-    WavFile(const WavFile& other) = delete;
-    WavFile(WavFile&& other) {
-        Descriptor          = other.Descriptor;
-        Format              = other.Format;
-        Data                = other.Data;
-        other.Data.size     = 0;
-        other.Data.data     = nullptr;
-        Chunks              = other.Chunks;
-        other.Chunks.length = 0;
-        other.Chunks.chunks = nullptr;
+    Block* blocks; // Blocks in use, newest first
+    Block* last;   // Oldest block in use
+    Block* spare;  // Blocks kept for reuse
+    size_t blockSize;
+
+    static void* arenaAlloc(void* context, size_t size, size_t alignment) {
+        return ((WavArena*)context)->allocate(size, alignment);
     }
+};
 
-    ~WavFile() {
-        free(Data.data);
-        for (int64_t i = 0; i < Chunks.length; i++)
-            free(Chunks.chunks[i].data);
-        free(Chunks.chunks);
+// Three byte sample, for moving packed 24-bit audio around
+struct WavSample24 {
+    uint8_t bytes[3];
+
+    // Sign-extended value
+    operator int32_t() const {
+        return (int32_t)((uint32_t)bytes[0] << 8 | (uint32_t)bytes[1] << 16 |
+                         (uint32_t)bytes[2] << 24) >> 8;
     }
+    WavSample24& operator=(int32_t value) {
+        bytes[0] = value;
+        bytes[1] = value >> 8;
+        bytes[2] = value >> 16;
+        return *this;
+    }
+};
 
-  private:
-    static WavError readHeader(WavFile* wavfile, FILE* file) {
-        // Read Descriptor
-        readFile(&wavfile->Descriptor, file);
-        if (*(uint32_t*)wavfile->Descriptor.RIFF != *(uint32_t*)RIFF)
-            return INVALID_DESCRIPTOR;
-        if (*(uint32_t*)wavfile->Descriptor.WAVE != *(uint32_t*)WAVE)
-            return INVALID_DESCRIPTOR;
+// Eight byte sample, 64-bit data is only 4-byte aligned after the header
+struct WavSample64 {
+    uint8_t bytes[8];
+};
 
-        // Read Format
-        readFile(&wavfile->Format, file);
-        if (*(uint32_t*)wavfile->Format.FMT != *(uint32_t*)fmt)
-            return NO_FORMAT;
+// State of the TPDF dither noise generator (one xorshift32 per vector lane)
+struct WavDither {
+    uint32_t state[8];
 
-        // Seek forward to the next chunk if format is longer
-        if (wavfile->Format.formatSize > 16) {
-            fseek(file, wavfile->Format.formatSize - 16, SEEK_CUR);
+    WavDither(uint32_t seed = 0x9E3779B9) {
+        for (int i = 0; i < 8; i++) {
+            seed     = seed * 1664525 + 1013904223;
+            state[i] = seed | 1;
         }
+    }
+};
 
-        return SUCCESS;
+// Sample kernels shared by the conversion paths.
+// SSE2 is used when enabled at compile time, AVX2 is dispatched at runtime.
+struct WavKernel {
+#ifdef WAV_AVX2
+    static bool hasAVX2() {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
     }
+#endif
 
-    static Chunk readChunk(FILE* file) {
-        // Read Chunk Header
-        Chunk chunk;
-        readFile(&chunk.tag, file);
-        readFile(&chunk.size, file);
+    // Splits interleaved frames into one buffer per channel,
+    // writing them to dst[c][offset] onwards. Samples are bytes wide.
+    static void deinterleave(const void* src, void* const* dst, size_t offset,
+                             size_t frames, uint32_t channels, uint32_t bytes) {
+        const uint8_t* in   = (const uint8_t*)src;
+        size_t         done = 0;
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            done += deinterleaveAVX2(in, dst, offset, frames, channels, bytes);
+#endif
+#ifdef WAV_SSE2
+        done += deinterleaveSSE2(in + done * channels * bytes, dst,
+                                 offset + done, frames - done, channels, bytes);
+#endif
+        in     += done * channels * bytes;
+        offset += done;
+        frames -= done;
 
-        // Check for end-of-file or errors
-        if (feof(file) || ferror(file)) {
-            chunk.data = NULL;
-            return chunk;
+        switch (bytes) {
+        case 1: deinterleaveScalar((const uint8_t*)in, dst, offset, frames, channels); break;
+        case 2: deinterleaveScalar((const uint16_t*)in, dst, offset, frames, channels); break;
+        case 3: deinterleaveScalar((const WavSample24*)in, dst, offset, frames, channels); break;
+        case 4: deinterleaveScalar((const uint32_t*)in, dst, offset, frames, channels); break;
+        case 8: deinterleaveScalar((const WavSample64*)in, dst, offset, frames, channels); break;
         }
+    }
 
-        // Read Chunk Data
-        chunk.data = malloc(chunk.size);
-        readFile(chunk.data, chunk.size, file);
+    // Converts count samples of the given width and format type to float.
+    // Signed PCM is scaled to [-1, 1), IEEE float is copied or narrowed.
+    static void toFloat(const void* src, float* dst, size_t count, uint32_t bits,
+                        uint16_t type) {
+        size_t i = 0;
 
-        return chunk;
+        if (type == FLOAT) {
+            if (bits == 32) {
+                memcpy(dst, src, count * sizeof(float));
+                return;
+            }
+#ifdef WAV_SSE2
+            for (; i + 4 <= count; i += 4) {
+                __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((const double*)src + i));
+                __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((const double*)src + i + 2));
+                _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+            }
+#endif
+            for (; i < count; i++) {
+                double sample;
+                memcpy(&sample, (const uint8_t*)src + i * sizeof(double), sizeof(double));
+                dst[i] = (float)sample;
+            }
+            return;
+        }
+
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += toFloatAVX2(src, dst, count, bits);
+#endif
+#ifdef WAV_SSE2
+        i += toFloatSSE2((const uint8_t*)src + i * (bits / 8), dst + i, count - i, bits);
+#endif
+        switch (bits) {
+        case 8:
+            for (; i < count; i++)
+                dst[i] = ((const int8_t*)src)[i] * (1 / 128.f);
+            break;
+        case 16:
+            for (; i < count; i++)
+                dst[i] = ((const int16_t*)src)[i] * (1 / 32768.f);
+            break;
+        case 24:
+            for (; i < count; i++) {
+                // Place the sample in the top bytes, scale as 32-bit
+                const uint8_t* b = (const uint8_t*)src + i * 3;
+                int32_t sample   = (int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 |
+                                           (uint32_t)b[2] << 24);
+                dst[i]           = sample * (1 / 2147483648.f);
+            }
+            break;
+        case 32:
+            for (; i < count; i++)
+                dst[i] = ((const int32_t*)src)[i] * (1 / 2147483648.f);
+            break;
+        }
     }
 
-  public:
-    WavError readMinimal(FILE* file) {
-        // Read Header
-        WavError error = WavFile::readHeader(this, file);
-        if (error)
-            return error;
+    // Inverse of deinterleave: merges src[c][offset] onwards into frames
+    static void interleave(const void* const* src, size_t offset, void* dst,
+                           size_t frames, uint32_t channels, uint32_t bytes) {
+        uint8_t* out  = (uint8_t*)dst;
+        size_t   done = 0;
+#ifdef WAV_SSE2
+        done += interleaveSSE2(src, offset, out, frames, channels, bytes);
+#endif
+        out    += done * channels * bytes;
+        offset += done;
+        frames -= done;
 
-        // Read first Data Chunk
-        // Search file, skipping non-data chunks
-        char tag[4];
-        while (true) {
-            fread(&tag, 4, 1, file);
-            if (tag[0] == 'd' && tag[1] == 'a' && tag[2] == 't' &&
-                tag[3] == 'a')
-                break; // Data chunk found
+        switch (bytes) {
+        case 1: interleaveScalar(src, offset, (uint8_t*)out, frames, channels); break;
+        case 2: interleaveScalar(src, offset, (uint16_t*)out, frames, channels); break;
+        case 3: interleaveScalar(src, offset, (WavSample24*)out, frames, channels); break;
+        case 4: interleaveScalar(src, offset, (uint32_t*)out, frames, channels); break;
+        case 8: interleaveScalar(src, offset, (WavSample64*)out, frames, channels); break;
+        }
+    }
 
-            // Skip chunk
-            uint32_t size;
-            fread(&size, 4, 1, file);
-            fseek(file, size, SEEK_CUR);
+    // Quantizes count floats in [-1, 1] to signed PCM of the given width,
+    // rounding to nearest and saturating. Adds TPDF dither when given a state.
+    // IEEE float output is copied or widened unchanged.
+    static void fromFloat(const float* src, void* dst, size_t count, uint32_t bits,
+                          uint16_t type, WavDither* dither) {
+        size_t i = 0;
 
-            // Exit when reaching end of file
-            if (feof(file))
-                return NO_DATA;
+        if (type == FLOAT) {
+            if (bits == 32) {
+                memcpy(dst, src, count * sizeof(float));
+                return;
+            }
+#ifdef WAV_SSE2
+            for (; i + 4 <= count; i += 4) {
+                __m128 x = _mm_loadu_ps(src + i);
+                _mm_storeu_pd((double*)dst + i, _mm_cvtps_pd(x));
+                _mm_storeu_pd((double*)dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+            }
+#endif
+            for (; i < count; i++) {
+                double sample = src[i];
+                memcpy((uint8_t*)dst + i * sizeof(double), &sample, sizeof(double));
+            }
+            return;
         }
 
-        // Set "data" tag
-        Data.DATA[0] = tag[0];
-        Data.DATA[1] = tag[1];
-        Data.DATA[2] = tag[2];
-        Data.DATA[3] = tag[3];
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += fromFloatAVX2(src, dst, count, bits, dither);
+#endif
+#ifdef WAV_SSE2
+        i += fromFloatSSE2(src + i, (uint8_t*)dst + i * (bits / 8), count - i,
+                           bits, dither);
+#endif
+        float full = fullScale(bits);
+        float lo   = -full;
+        float hi   = maxScale(bits);
+        for (; i < count; i++) {
+            float sample = src[i] * full;
+            if (dither)
+                sample += noise(dither->state[0]) + noise(dither->state[0]);
+            sample    = sample > lo ? sample : lo; // NaN becomes lo
+            sample    = sample < hi ? sample : hi;
+            int32_t q = (int32_t)lrintf(sample);
+            switch (bits) {
+            case 8: ((int8_t*)dst)[i] = q; break;
+            case 16: ((int16_t*)dst)[i] = q; break;
+            case 24: store24((uint8_t*)dst + i * 3, q); break;
+            case 32: ((int32_t*)dst)[i] = q; break;
+            }
+        }
+    }
 
-        // Read Data chunk size
-        fread(&Data.size, sizeof(Data.size), 1, file);
+    // Weighted sum of planar channels, dst[i] = sum of gains[c] * src[c][offset + i].
+    // Channels with a zero gain are not read.
+    static void mix(const float* const* src, size_t offset, const float* gains,
+                    uint32_t channels, float* dst, size_t count) {
+        size_t i = 0;
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += mixAVX2(src, offset, gains, channels, dst, count);
+#endif
+#ifdef WAV_SSE2
+        i += mixSSE2(src, offset + i, gains, channels, dst + i, count - i);
+#endif
+        for (; i < count; i++) {
+            float sum = 0;
+            for (uint32_t c = 0; c < channels; c++)
+                if (gains[c] != 0)
+                    sum += gains[c] * src[c][offset + i];
+            dst[i] = sum;
+        }
+    }
 
-        // Read the Data
-        Data.data = malloc(Data.size);
-        fread(Data.data, Data.size, 1, file);
+    // Widens lo and hi to the smallest and largest of count samples,
+    // and adds their sum of squares to squares
+    static void peaks(const float* src, size_t count, float& lo, float& hi, double& squares) {
+        size_t i = 0;
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += peaksAVX2(src, count, lo, hi, squares);
+#endif
+#ifdef WAV_SSE2
+        i += peaksSSE2(src + i, count - i, lo, hi, squares);
+#endif
+        for (; i < count; i++) {
+            lo       = src[i] < lo ? src[i] : lo;
+            hi       = src[i] > hi ? src[i] : hi;
+            squares += (double)src[i] * src[i];
+        }
+    }
 
-        return SUCCESS;
+    // Sum of a[i] * b[i]
+    static float dot(const float* a, const float* b, size_t count) {
+        float  sum = 0;
+        size_t i   = 0;
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += dotAVX2(a, b, count, sum);
+#endif
+#ifdef WAV_SSE2
+        i += dotSSE2(a + i, b + i, count - i, sum);
+#endif
+        for (; i < count; i++)
+            sum += a[i] * b[i];
+        return sum;
     }
 
-    WavError read(FILE* file) {
-        // Read Header
-        WavError error = WavFile::readHeader(this, file);
-        if (error)
-            return error;
+    // Folds 64-byte stripes into eight 64-bit lanes: for each word j of a
+    // stripe, acc[j ^ 1] += word and acc[j] += low * high half of word ^ key[j]
+    static void accumulate(uint64_t* acc, const uint64_t* key, const uint8_t* src,
+                           size_t stripes) {
+        size_t i = 0;
+#ifdef WAV_AVX2
+        if (hasAVX2())
+            i += accumulateAVX2(acc, key, src, stripes);
+#endif
+#ifdef WAV_SSE2
+        i += accumulateSSE2(acc, key, src + i * 64, stripes - i);
+#endif
+        for (; i < stripes; i++)
+            for (int j = 0; j < 8; j++) {
+                uint64_t word;
+                memcpy(&word, src + i * 64 + j * 8, 8);
+                uint64_t mixed  = word ^ key[j];
+                acc[j ^ 1]     += word;
+                acc[j]         += (mixed & 0xFFFFFFFF) * (mixed >> 32);
+            }
+    }
 
-        // Prepare dynamic array and allocate a generous initial capacity
-        uint32_t chunksCapacity = 32;
-        Chunks.length           = 0;
-        Chunks.chunks           = (Chunk*)malloc(sizeof(Chunk) * chunksCapacity);
+  private:
+    // Magnitude of the most negative sample, and the largest positive sample
+    // (for 32-bit the largest float below 2^31)
+    static float fullScale(uint32_t bits) { return (float)(1u << (bits - 1)); }
+    static float maxScale(uint32_t bits) {
+        return bits == 32 ? 2147483520.f : fullScale(bits) - 1;
+    }
 
-        // Read Chunks
-        bool foundData = false;
-        while (true) {
+    static void store24(uint8_t* dst, int32_t sample) {
+        dst[0] = sample;
+        dst[1] = sample >> 8;
+        dst[2] = sample >> 16;
+    }
 
-            // Read Chunk and check for eof or error
-            Chunk chunk = WavFile::readChunk(file);
-            if (chunk.data == NULL)
-                break;
+    // Uniform noise in [-0.5, 0.5) LSB
+    static float noise(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        uint32_t bits = (state >> 9) | 0x3f800000;
+        float    uniform;
+        memcpy(&uniform, &bits, sizeof(uniform));
+        return uniform - 1.5f;
+    }
 
-            // (only the first) Data chunk is handled separately
-            if (!foundData && chunk.tag[0] == 'd' && chunk.tag[1] == 'a' &&
-                chunk.tag[2] == 't' && chunk.tag[3] == 'a') {
-                // Write tag
-                Data.DATA[0] = chunk.tag[0];
-                Data.DATA[1] = chunk.tag[1];
-                Data.DATA[2] = chunk.tag[2];
-                Data.DATA[3] = chunk.tag[3];
-
-                // Write size and data
-                Data.size = chunk.size;
-                Data.data = chunk.data;
+    template <typename T>
+    static void interleaveScalar(const void* const* src, size_t offset, T* dst,
+                                 size_t frames, uint32_t channels) {
+        for (size_t i = 0; i < frames; i++)
+            for (uint32_t c = 0; c < channels; c++)
+                dst[i * channels + c] = ((const T*)src[c])[offset + i];
+    }
 
-                foundData = true;
+#ifdef WAV_SSE2
+    static size_t interleaveSSE2(const void* const* src, size_t offset, uint8_t* dst,
+                                 size_t frames, uint32_t channels, uint32_t bytes) {
+        size_t i = 0;
 
-                // Handle other tags
-            } else {
-                // Reallocate dynamic array
-                if (chunksCapacity <= Chunks.length) {
-                    // Double Capacity when insufficent
-                    chunksCapacity *= 2;
-                    Chunks.chunks   = (Chunk*)reallocarray(
-                        Chunks.chunks, chunksCapacity, sizeof(Chunk));
-                }
+        if (bytes == 4 && channels == 2) {
+            const float* c0 = (const float*)src[0] + offset;
+            const float* c1 = (const float*)src[1] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                __m128 a = _mm_loadu_ps(c0 + i), b = _mm_loadu_ps(c1 + i);
+                _mm_storeu_ps((float*)(dst + i * 8), _mm_unpacklo_ps(a, b));
+                _mm_storeu_ps((float*)(dst + i * 8 + 16), _mm_unpackhi_ps(a, b));
+            }
+        }
 
-                Chunks.chunks[Chunks.length] = chunk;
-                Chunks.length++;
+        if (bytes == 4 && channels == 4) {
+            const float* c[4];
+            for (int j = 0; j < 4; j++)
+                c[j] = (const float*)src[j] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                float* d  = (float*)(dst + i * 16);
+                __m128 r0 = _mm_loadu_ps(c[0] + i), r1 = _mm_loadu_ps(c[1] + i);
+                __m128 r2 = _mm_loadu_ps(c[2] + i), r3 = _mm_loadu_ps(c[3] + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(d, r0);
+                _mm_storeu_ps(d + 4, r1);
+                _mm_storeu_ps(d + 8, r2);
+                _mm_storeu_ps(d + 12, r3);
             }
         }
 
-        // Resize dynamic array to fit
-        Chunks.chunks =
-            (Chunk*)reallocarray(Chunks.chunks, Chunks.length, sizeof(Chunk));
+        if (bytes == 4 && channels == 8) {
+            const float* c[8];
+            for (int j = 0; j < 8; j++)
+                c[j] = (const float*)src[j] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                float* d  = (float*)(dst + i * 32);
+                __m128 l0 = _mm_loadu_ps(c[0] + i), l1 = _mm_loadu_ps(c[1] + i);
+                __m128 l2 = _mm_loadu_ps(c[2] + i), l3 = _mm_loadu_ps(c[3] + i);
+                __m128 h0 = _mm_loadu_ps(c[4] + i), h1 = _mm_loadu_ps(c[5] + i);
+                __m128 h2 = _mm_loadu_ps(c[6] + i), h3 = _mm_loadu_ps(c[7] + i);
+                _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+                _MM_TRANSPOSE4_PS(h0, h1, h2, h3);
+                _mm_storeu_ps(d, l0);
+                _mm_storeu_ps(d + 4, h0);
+                _mm_storeu_ps(d + 8, l1);
+                _mm_storeu_ps(d + 12, h1);
+                _mm_storeu_ps(d + 16, l2);
+                _mm_storeu_ps(d + 20, h2);
+                _mm_storeu_ps(d + 24, l3);
+                _mm_storeu_ps(d + 28, h3);
+            }
+        }
 
-        // Return with the appropiate error code
-        return foundData ? SUCCESS : NO_DATA;
+        return i;
     }
 
-    void write(FILE* file) {
-        // Write Header
-        writeFile(&Descriptor, file);
-        writeFile(&Format, file);
+    static size_t mixSSE2(const float* const* src, size_t offset, const float* gains,
+                          uint32_t channels, float* dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+            for (uint32_t c = 0; c < channels; c++) {
+                if (gains[c] == 0)
+                    continue;
+                const float* s = src[c] + offset + i;
+                __m128       g = _mm_set1_ps(gains[c]);
+                acc0           = _mm_add_ps(acc0, _mm_mul_ps(g, _mm_loadu_ps(s)));
+                acc1           = _mm_add_ps(acc1, _mm_mul_ps(g, _mm_loadu_ps(s + 4)));
+            }
+            _mm_storeu_ps(dst + i, acc0);
+            _mm_storeu_ps(dst + i + 4, acc1);
+        }
+        return i;
+    }
 
-        // Write Data
-        writeFile(&Data, sizeof(Data) - sizeof(void*), file);
-        writeFile(Data.data, Data.size, file);
+    static size_t peaksSSE2(const float* src, size_t count, float& lo, float& hi,
+                            double& squares) {
+        if (count < 4)
+            return 0;
 
-        // Write Chunks
-        for (int64_t i = 0; i < Chunks.length; i++) {
-            writeFile(&Chunks.chunks[i], sizeof(Chunk) - sizeof(void*), file);
-            writeFile(Chunks.chunks[i].data, Chunks.chunks[i].size, file);
+        __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi), sum = _mm_setzero_ps();
+        size_t i   = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i);
+            vlo      = _mm_min_ps(vlo, x);
+            vhi      = _mm_max_ps(vhi, x);
+            sum      = _mm_add_ps(sum, _mm_mul_ps(x, x));
+        }
+
+        float l[4], h[4], q[4];
+        _mm_storeu_ps(l, vlo);
+        _mm_storeu_ps(h, vhi);
+        _mm_storeu_ps(q, sum);
+        for (int j = 0; j < 4; j++) {
+            lo       = l[j] < lo ? l[j] : lo;
+            hi       = h[j] > hi ? h[j] : hi;
+            squares += q[j];
         }
+        return i;
     }
 
-    void* getRawData(WavChannelLayout channelLayout) {
-        void* raw      = Data.data;
-        int   channels = Format.channels;
-        int   bits     = Format.bitsPerSample;
-        int   samples  = Data.size / Format.blockSize;
+    static size_t dotSSE2(const float* a, const float* b, size_t count, float& sum) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        size_t i    = 0;
+        for (; i + 8 <= count; i += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        for (; i + 4 <= count; i += 4)
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
 
-        if (channels <= 1)
-            return raw;
+        acc0 = _mm_add_ps(acc0, acc1);
+        acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+        acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+        sum += _mm_cvtss_f32(acc0);
+        return i;
+    }
 
-        if (channelLayout == INTERLIEVED)
-            return raw;
+    static size_t accumulateSSE2(uint64_t* acc, const uint64_t* key, const uint8_t* src,
+                                 size_t stripes) {
+        __m128i a[4], k[4];
+        for (int j = 0; j < 4; j++) {
+            a[j] = _mm_loadu_si128((const __m128i*)acc + j);
+            k[j] = _mm_loadu_si128((const __m128i*)key + j);
+        }
+        for (size_t i = 0; i < stripes; i++)
+            for (int j = 0; j < 4; j++) {
+                __m128i word    = _mm_loadu_si128((const __m128i*)(src + i * 64) + j);
+                __m128i mixed   = _mm_xor_si128(word, k[j]);
+                __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+                __m128i swapped = _mm_shuffle_epi32(word, _MM_SHUFFLE(1, 0, 3, 2));
+                a[j]            = _mm_add_epi64(a[j], _mm_add_epi64(product, swapped));
+            }
+        for (int j = 0; j < 4; j++)
+            _mm_storeu_si128((__m128i*)acc + j, a[j]);
+        return stripes;
+    }
 
-        if (bits == 8) {
-            int8_t*  data        = (int8_t*)malloc(samples * channels * sizeof(int8_t));
-            int8_t** channelData = (int8_t**)malloc(channels * sizeof(int8_t*));
+    static __m128 noiseSSE2(__m128i& state) {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        __m128i bits = _mm_or_si128(_mm_srli_epi32(state, 9), _mm_set1_epi32(0x3f800000));
+        return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.5f));
+    }
 
-            for (int i = 0; i < channels; i++)
-                channelData[i] = data + i * samples;
+    static size_t fromFloatSSE2(const float* src, void* dst, size_t count, uint32_t bits,
+                                WavDither* dither) {
+        const __m128 scale = _mm_set1_ps(fullScale(bits));
+        const __m128 lo    = _mm_set1_ps(-fullScale(bits));
+        const __m128 hi    = _mm_set1_ps(maxScale(bits));
+        __m128i      state = _mm_setzero_si128();
+        if (dither)
+            state = _mm_loadu_si128((const __m128i*)dither->state);
 
-            for (int i = 0; i < samples; i++)
-                for (int j = 0; j < channels; j++)
-                    channelData[j][i] = ((int8_t*)raw)[i * channels + j];
+        // Scale, dither, clamp and round 4 samples (maxps turns NaN into lo)
+        auto quantize = [&](const float* s) {
+            __m128 x = _mm_mul_ps(_mm_loadu_ps(s), scale);
+            if (dither)
+                x = _mm_add_ps(x, _mm_add_ps(noiseSSE2(state), noiseSSE2(state)));
+            x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+            return _mm_cvtps_epi32(x);
+        };
 
-            if (channelLayout == INLINE)
-                return data;
-            if (channelLayout == SPLIT)
-                return channelData;
-            return NULL;
+        size_t i = 0;
+        if (bits == 8) {
+            for (; i + 16 <= count; i += 16) {
+                __m128i a = _mm_packs_epi32(quantize(src + i), quantize(src + i + 4));
+                __m128i b = _mm_packs_epi32(quantize(src + i + 8), quantize(src + i + 12));
+                _mm_storeu_si128((__m128i*)((int8_t*)dst + i), _mm_packs_epi16(a, b));
+            }
         }
         if (bits == 16) {
-            int16_t* data =
-                (int16_t*)malloc(samples * channels * sizeof(int16_t));
-            int16_t** channelData =
-                (int16_t**)malloc(channels * sizeof(int16_t*));
-
-            for (int i = 0; i < channels; i++)
-                channelData[i] = data + i * samples;
-
-            for (int i = 0; i < samples; i++)
-                for (int j = 0; j < channels; j++)
-                    channelData[j][i] = ((int16_t*)raw)[i * channels + j];
-
-            if (channelLayout == INLINE)
-                return data;
-            if (channelLayout == SPLIT)
-                return channelData;
-            return NULL;
+            for (; i + 8 <= count; i += 8) {
+                __m128i a = _mm_packs_epi32(quantize(src + i), quantize(src + i + 4));
+                _mm_storeu_si128((__m128i*)((int16_t*)dst + i), a);
+            }
         }
-        if (bits == 32) {
-            int32_t* data =
-                (int32_t*)malloc(samples * channels * sizeof(int32_t));
-            int32_t** channelData =
-                (int32_t**)malloc(channels * sizeof(int32_t*));
-
-            for (int i = 0; i < channels; i++)
-                channelData[i] = data + i * samples;
-
-            for (int i = 0; i < samples; i++)
-                for (int j = 0; j < channels; j++)
-                    channelData[j][i] = ((int32_t*)raw)[i * channels + j];
-
-            if (channelLayout == INLINE)
-                return data;
-            if (channelLayout == SPLIT)
-                return channelData;
-            return NULL;
+        if (bits == 24) {
+            // No byte shuffles in SSE2, pack the rounded samples one by one
+            for (; i + 4 <= count; i += 4) {
+                int32_t q[4];
+                _mm_storeu_si128((__m128i*)q, quantize(src + i));
+                for (int j = 0; j < 4; j++)
+                    store24((uint8_t*)dst + (i + j) * 3, q[j]);
+            }
         }
-        if (bits == 64) {
-            int64_t* data =
-                (int64_t*)malloc(samples * channels * sizeof(int64_t));
-            int64_t** channelData =
-                (int64_t**)malloc(channels * sizeof(int64_t*));
-
-            for (int i = 0; i < channels; i++)
-                channelData[i] = data + i * samples;
-
-            for (int i = 0; i < samples; i++)
-                for (int j = 0; j < channels; j++)
-                    channelData[j][i] = ((int64_t*)raw)[i * channels + j];
-
-            if (channelLayout == INLINE)
-                return data;
-            if (channelLayout == SPLIT)
-                return channelData;
-            return NULL;
+        if (bits == 32) {
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_si128((__m128i*)((int32_t*)dst + i), quantize(src + i));
         }
 
-        // Unsupported bit depth
-        return NULL;
+        if (dither)
+            _mm_storeu_si128((__m128i*)dither->state, state);
+        return i;
     }
 
-  public:
-#define READ_SAMPLES(type, scale)                               \
-    for (uint32_t i = 0; i < samples; i++) {                    \
-        for (uint32_t c = 0; c < channels; c++) {               \
-            type sample = ((type*)Data.data)[i * channels + c]; \
-            data[c][i]  = sample * (scale);                     \
-        }                                                       \
-    }
-    WavData<float> getData() {
-        // Not Supported
-        if (!(Format.bitsPerSample == 8 || Format.bitsPerSample == 16 ||
-              Format.bitsPerSample == 32)) {
-            return {0, 0, nullptr};
-        }
+    static size_t toFloatSSE2(const void* src, float* dst, size_t count, uint32_t bits) {
+        size_t i = 0;
 
-        // Not Implemented
-        if (Format.formatType != WavFormatType::PCM) {
-            return {0, 0, nullptr};
+        if (bits == 8) {
+            const __m128 scale = _mm_set1_ps(1 / 128.f);
+            for (; i + 16 <= count; i += 16) {
+                __m128i x  = _mm_loadu_si128((const __m128i*)((const int8_t*)src + i));
+                __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+                __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+                __m128i w0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16);
+                __m128i w1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16);
+                __m128i w2 = _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16);
+                __m128i w3 = _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16);
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(w0), scale));
+                _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(w1), scale));
+                _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(w2), scale));
+                _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(w3), scale));
+            }
         }
 
-        // Allocate space for data
-        uint32_t samples  = Data.size / Format.blockSize;
-        uint32_t channels = Format.channels;
-        float**  data     = (float**)malloc(channels * sizeof(float*));
-        for (uint32_t i = 0; i < channels; i++) {
-            data[i] = (float*)malloc(samples * sizeof(float));
+        if (bits == 16) {
+            const __m128 scale = _mm_set1_ps(1 / 32768.f);
+            for (; i + 8 <= count; i += 8) {
+                __m128i x  = _mm_loadu_si128((const __m128i*)((const int16_t*)src + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+                _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+            }
         }
 
-        switch (Format.bitsPerSample) {
-        case 8: {
-            READ_SAMPLES(int8_t, 1 / 128.f);
-        } break;
-        case 16: {
-            READ_SAMPLES(int16_t, 1 / 32768.f);
-        } break;
-        case 32: {
-            READ_SAMPLES(int32_t, 1 / 2147483648.f);
-        } break;
+        if (bits == 32) {
+            const __m128 scale = _mm_set1_ps(1 / 2147483648.f);
+            for (; i + 4 <= count; i += 4) {
+                __m128i x = _mm_loadu_si128((const __m128i*)((const int32_t*)src + i));
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+            }
         }
 
-        return {channels, samples, data};
+        return i;
     }
-#undef READ_SAMPLES
+#endif
 
-#define WRITE_SAMPLES(type, scale)                                                                 \
-    for (uint32_t i = 0; i < data.samples; i++) {                                                  \
-        for (uint32_t c = 0; c < data.channels; c++) {                                             \
-            float sample                              = data.data[c][i];                           \
-            sample                                    = fmax(fmin(sample, 1.0f - (scale)), -1.0f); \
-            ((type*)Data.data)[i * data.channels + c] = sample / (scale);                          \
-        }                                                                                          \
-    }
-    void setData(WavData<float> data) {
-        if (data.channels != Format.channels) {
-            printf("Error: Channel count mismatch\n");
-            return;
-        }
-        if (data.samples != Data.size / Format.blockSize) {
-            printf("Error: Sample count mismatch\n");
-            return;
+#ifdef WAV_AVX2
+    WAV_TARGET_AVX2
+    static size_t mixAVX2(const float* const* src, size_t offset, const float* gains,
+                          uint32_t channels, float* dst, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+            for (uint32_t c = 0; c < channels; c++) {
+                if (gains[c] == 0)
+                    continue;
+                const float* s = src[c] + offset + i;
+                __m256       g = _mm256_set1_ps(gains[c]);
+                acc0           = _mm256_add_ps(acc0, _mm256_mul_ps(g, _mm256_loadu_ps(s)));
+                acc1           = _mm256_add_ps(acc1, _mm256_mul_ps(g, _mm256_loadu_ps(s + 8)));
+            }
+            _mm256_storeu_ps(dst + i, acc0);
+            _mm256_storeu_ps(dst + i + 8, acc1);
         }
+        return i;
+    }
 
-        // Not Supported
-        if (!(Format.bitsPerSample == 8 || Format.bitsPerSample == 16 ||
-              Format.bitsPerSample == 32)) {
-            return;
-        }
+    WAV_TARGET_AVX2
+    static size_t peaksAVX2(const float* src, size_t count, float& lo, float& hi,
+                            double& squares) {
+        if (count < 8)
+            return 0;
 
-        // Not Implemented
-        if (Format.formatType != WavFormatType::PCM) {
-            return;
+        __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi), sum = _mm256_setzero_ps();
+        size_t i   = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(src + i);
+            vlo      = _mm256_min_ps(vlo, x);
+            vhi      = _mm256_max_ps(vhi, x);
+            sum      = _mm256_add_ps(sum, _mm256_mul_ps(x, x));
         }
 
-        // Write data
-        switch (Format.bitsPerSample) {
-        case 8: {
-            WRITE_SAMPLES(int8_t, 1 / 128.f);
-        } break;
-        case 16: {
-            WRITE_SAMPLES(int16_t, 1 / 32768.f);
-        } break;
-        case 32: {
-            WRITE_SAMPLES(int32_t, 1 / 2147483648.f);
-        } break;
+        float l[8], h[8], q[8];
+        _mm256_storeu_ps(l, vlo);
+        _mm256_storeu_ps(h, vhi);
+        _mm256_storeu_ps(q, sum);
+        for (int j = 0; j < 8; j++) {
+            lo       = l[j] < lo ? l[j] : lo;
+            hi       = h[j] > hi ? h[j] : hi;
+            squares += q[j];
         }
+        return i;
     }
 
-    void print() {
+    WAV_TARGET_AVX2
+    static size_t dotAVX2(const float* a, const float* b, size_t count, float& sum) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        size_t i    = 0;
+        for (; i + 16 <= count; i += 16) {
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+        }
+        for (; i + 8 <= count; i += 8)
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+        acc0     = _mm256_add_ps(acc0, acc1);
+        __m128 x = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+        x        = _mm_add_ps(x, _mm_movehl_ps(x, x));
+        x        = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+        sum     += _mm_cvtss_f32(x);
+        return i;
+    }
+
+    WAV_TARGET_AVX2
+    static size_t accumulateAVX2(uint64_t* acc, const uint64_t* key, const uint8_t* src,
+                                 size_t stripes) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)acc + 1);
+        __m256i k0 = _mm256_loadu_si256((const __m256i*)key);
+        __m256i k1 = _mm256_loadu_si256((const __m256i*)key + 1);
+        for (size_t i = 0; i < stripes; i++) {
+            const __m256i* s  = (const __m256i*)(src + i * 64);
+            __m256i        w0 = _mm256_loadu_si256(s), w1 = _mm256_loadu_si256(s + 1);
+            __m256i        m0 = _mm256_xor_si256(w0, k0), m1 = _mm256_xor_si256(w1, k1);
+            a0 = _mm256_add_epi64(a0, _mm256_mul_epu32(m0, _mm256_srli_epi64(m0, 32)));
+            a1 = _mm256_add_epi64(a1, _mm256_mul_epu32(m1, _mm256_srli_epi64(m1, 32)));
+            a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(w0, _MM_SHUFFLE(1, 0, 3, 2)));
+            a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(w1, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+        _mm256_storeu_si256((__m256i*)acc, a0);
+        _mm256_storeu_si256((__m256i*)acc + 1, a1);
+        return stripes;
+    }
+
+    WAV_TARGET_AVX2
+    static __m256 noiseAVX2(__m256i& state) {
+        state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+        state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+        state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+        __m256i bits = _mm256_or_si256(_mm256_srli_epi32(state, 9), _mm256_set1_epi32(0x3f800000));
+        return _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.5f));
+    }
+
+    WAV_TARGET_AVX2
+    static __m256i quantizeAVX2(const float* src, __m256 scale, __m256 lo, __m256 hi,
+                                __m256i* state) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src), scale);
+        if (state)
+            x = _mm256_add_ps(x, _mm256_add_ps(noiseAVX2(*state), noiseAVX2(*state)));
+        x = _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+        return _mm256_cvtps_epi32(x);
+    }
+
+    WAV_TARGET_AVX2
+    static size_t fromFloatAVX2(const float* src, void* dst, size_t count, uint32_t bits,
+                                WavDither* dither) {
+        const __m256 scale  = _mm256_set1_ps(fullScale(bits));
+        const __m256 lo     = _mm256_set1_ps(-fullScale(bits));
+        const __m256 hi     = _mm256_set1_ps(maxScale(bits));
+        __m256i      state  = _mm256_setzero_si256();
+        __m256i*     noise  = dither ? &state : nullptr;
+        if (dither)
+            state = _mm256_loadu_si256((const __m256i*)dither->state);
+
+        size_t i = 0;
+        if (bits == 8) {
+            // Packing works per 128-bit lane, restore sample order
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            for (; i + 32 <= count; i += 32) {
+                __m256i a = _mm256_packs_epi32(quantizeAVX2(src + i, scale, lo, hi, noise),
+                                               quantizeAVX2(src + i + 8, scale, lo, hi, noise));
+                __m256i b = _mm256_packs_epi32(quantizeAVX2(src + i + 16, scale, lo, hi, noise),
+                                               quantizeAVX2(src + i + 24, scale, lo, hi, noise));
+                __m256i p = _mm256_packs_epi16(a, b);
+                _mm256_storeu_si256((__m256i*)((int8_t*)dst + i), _mm256_permutevar8x32_epi32(p, order));
+            }
+        }
+        if (bits == 16) {
+            for (; i + 16 <= count; i += 16) {
+                __m256i a = _mm256_packs_epi32(quantizeAVX2(src + i, scale, lo, hi, noise),
+                                               quantizeAVX2(src + i + 8, scale, lo, hi, noise));
+                _mm256_storeu_si256((__m256i*)((int16_t*)dst + i), _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+        }
+        if (bits == 24) {
+            // Drop the top byte of each sample, then close the gap between the lanes
+            const __m256i pack  = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                   0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            const __m256i order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+            for (; i + 8 <= count; i += 8) {
+                __m256i  q = quantizeAVX2(src + i, scale, lo, hi, noise);
+                __m256i  p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(q, pack), order);
+                uint8_t* d = (uint8_t*)dst + i * 3;
+                _mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(p));
+                _mm_storel_epi64((__m128i*)(d + 16), _mm256_extracti128_si256(p, 1));
+            }
+        }
+        if (bits == 32) {
+            for (; i + 8 <= count; i += 8)
+                _mm256_storeu_si256((__m256i*)((int32_t*)dst + i), quantizeAVX2(src + i, scale, lo, hi, noise));
+        }
+
+        if (dither)
+            _mm256_storeu_si256((__m256i*)dither->state, state);
+        return i;
+    }
+
+    WAV_TARGET_AVX2
+    static size_t toFloatAVX2(const void* src, float* dst, size_t count, uint32_t bits) {
+        size_t i = 0;
+
+        if (bits == 8) {
+            const __m256 scale = _mm256_set1_ps(1 / 128.f);
+            for (; i + 8 <= count; i += 8) {
+                __m128i x = _mm_loadl_epi64((const __m128i*)((const int8_t*)src + i));
+                __m256i w = _mm256_cvtepi8_epi32(x);
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(w), scale));
+            }
+        }
+
+        if (bits == 16) {
+            const __m256 scale = _mm256_set1_ps(1 / 32768.f);
+            for (; i + 8 <= count; i += 8) {
+                __m128i x = _mm_loadu_si128((const __m128i*)((const int16_t*)src + i));
+                __m256i w = _mm256_cvtepi16_epi32(x);
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(w), scale));
+            }
+        }
+
+        if (bits == 24) {
+            // Give each lane 12 bytes, then move every sample to the top of a 32-bit word.
+            // Each iteration loads 32 bytes but consumes 24, so stop short of the end.
+            const __m256  scale  = _mm256_set1_ps(1 / 2147483648.f);
+            const __m256i order  = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+            const __m256i unpack = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                    -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+            for (; i + 11 <= count; i += 8) {
+                __m256i x = _mm256_loadu_si256((const __m256i*)((const uint8_t*)src + i * 3));
+                x         = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(x, order), unpack);
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+            }
+        }
+
+        if (bits == 32) {
+            const __m256 scale = _mm256_set1_ps(1 / 2147483648.f);
+            for (; i + 8 <= count; i += 8) {
+                __m256i x = _mm256_loadu_si256((const __m256i*)((const int32_t*)src + i));
+                _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+            }
+        }
+
+        return i;
+    }
+#endif
+
+    template <typename T, uint32_t C>
+    static void deinterleaveFixed(const T* src, void* const* dst, size_t offset,
+                                  size_t frames) {
+        T* out[C];
+        for (uint32_t c = 0; c < C; c++)
+            out[c] = (T*)dst[c] + offset;
+
+        for (size_t i = 0; i < frames; i++)
+            for (uint32_t c = 0; c < C; c++)
+                out[c][i] = src[i * C + c];
+    }
+
+    template <typename T>
+    static void deinterleaveScalar(const T* src, void* const* dst, size_t offset,
+                                   size_t frames, uint32_t channels) {
+        switch (channels) {
+        case 1: deinterleaveFixed<T, 1>(src, dst, offset, frames); return;
+        case 2: deinterleaveFixed<T, 2>(src, dst, offset, frames); return;
+        case 4: deinterleaveFixed<T, 4>(src, dst, offset, frames); return;
+        case 6: deinterleaveFixed<T, 6>(src, dst, offset, frames); return;
+        case 8: deinterleaveFixed<T, 8>(src, dst, offset, frames); return;
+        }
+
+        for (size_t i = 0; i < frames; i++)
+            for (uint32_t c = 0; c < channels; c++)
+                ((T*)dst[c])[offset + i] = src[i * channels + c];
+    }
+
+#ifdef WAV_SSE2
+    // Each kernel handles whole vectors and returns the frames it processed,
+    // the scalar code finishes the remainder.
+    static size_t deinterleaveSSE2(const uint8_t* src, void* const* dst, size_t offset,
+                                   size_t frames, uint32_t channels, uint32_t bytes) {
+        size_t i = 0;
+
+        if (bytes == 1 && channels == 2) {
+            int8_t* c0 = (int8_t*)dst[0] + offset;
+            int8_t* c1 = (int8_t*)dst[1] + offset;
+            for (; i + 16 <= frames; i += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 2));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+                __m128i la = _mm_srai_epi16(_mm_slli_epi16(a, 8), 8);
+                __m128i lb = _mm_srai_epi16(_mm_slli_epi16(b, 8), 8);
+                _mm_storeu_si128((__m128i*)(c0 + i), _mm_packs_epi16(la, lb));
+                _mm_storeu_si128((__m128i*)(c1 + i),
+                                 _mm_packs_epi16(_mm_srai_epi16(a, 8), _mm_srai_epi16(b, 8)));
+            }
+        }
+
+        if (bytes == 2 && channels == 2) {
+            int16_t* c0 = (int16_t*)dst[0] + offset;
+            int16_t* c1 = (int16_t*)dst[1] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 4));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+                __m128i la = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+                __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+                _mm_storeu_si128((__m128i*)(c0 + i), _mm_packs_epi32(la, lb));
+                _mm_storeu_si128((__m128i*)(c1 + i),
+                                 _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+            }
+        }
+
+        if (bytes == 2 && channels == 4) {
+            int16_t* c[4];
+            for (int j = 0; j < 4; j++)
+                c[j] = (int16_t*)dst[j] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                const __m128i* s = (const __m128i*)(src + i * 8);
+                __m128i r0 = _mm_loadu_si128(s + 0), r1 = _mm_loadu_si128(s + 1);
+                __m128i r2 = _mm_loadu_si128(s + 2), r3 = _mm_loadu_si128(s + 3);
+                __m128i t0 = _mm_unpacklo_epi16(r0, r1), t1 = _mm_unpackhi_epi16(r0, r1);
+                __m128i t2 = _mm_unpacklo_epi16(r2, r3), t3 = _mm_unpackhi_epi16(r2, r3);
+                __m128i u0 = _mm_unpacklo_epi16(t0, t1), u1 = _mm_unpackhi_epi16(t0, t1);
+                __m128i v0 = _mm_unpacklo_epi16(t2, t3), v1 = _mm_unpackhi_epi16(t2, t3);
+                _mm_storeu_si128((__m128i*)(c[0] + i), _mm_unpacklo_epi64(u0, v0));
+                _mm_storeu_si128((__m128i*)(c[1] + i), _mm_unpackhi_epi64(u0, v0));
+                _mm_storeu_si128((__m128i*)(c[2] + i), _mm_unpacklo_epi64(u1, v1));
+                _mm_storeu_si128((__m128i*)(c[3] + i), _mm_unpackhi_epi64(u1, v1));
+            }
+        }
+
+        if (bytes == 2 && channels == 8) {
+            int16_t* c[8];
+            for (int j = 0; j < 8; j++)
+                c[j] = (int16_t*)dst[j] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                const __m128i* s = (const __m128i*)(src + i * 16);
+                __m128i r[8], t[8], u[8];
+                for (int j = 0; j < 8; j++)
+                    r[j] = _mm_loadu_si128(s + j);
+                for (int j = 0; j < 8; j += 2) {
+                    t[j]     = _mm_unpacklo_epi16(r[j], r[j + 1]);
+                    t[j + 1] = _mm_unpackhi_epi16(r[j], r[j + 1]);
+                }
+                for (int j = 0; j < 8; j += 4) {
+                    u[j]     = _mm_unpacklo_epi32(t[j], t[j + 2]);
+                    u[j + 1] = _mm_unpackhi_epi32(t[j], t[j + 2]);
+                    u[j + 2] = _mm_unpacklo_epi32(t[j + 1], t[j + 3]);
+                    u[j + 3] = _mm_unpackhi_epi32(t[j + 1], t[j + 3]);
+                }
+                for (int j = 0; j < 4; j++) {
+                    _mm_storeu_si128((__m128i*)(c[j * 2] + i), _mm_unpacklo_epi64(u[j], u[j + 4]));
+                    _mm_storeu_si128((__m128i*)(c[j * 2 + 1] + i), _mm_unpackhi_epi64(u[j], u[j + 4]));
+                }
+            }
+        }
+
+        if (bytes == 4 && channels == 2) {
+            float* c0 = (float*)dst[0] + offset;
+            float* c1 = (float*)dst[1] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                const float* s = (const float*)(src + i * 8);
+                __m128       a = _mm_loadu_ps(s), b = _mm_loadu_ps(s + 4);
+                _mm_storeu_ps(c0 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(c1 + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+        }
+
+        if (bytes == 4 && channels == 4) {
+            float* c[4];
+            for (int j = 0; j < 4; j++)
+                c[j] = (float*)dst[j] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                const float* s  = (const float*)(src + i * 16);
+                __m128       r0 = _mm_loadu_ps(s), r1 = _mm_loadu_ps(s + 4);
+                __m128       r2 = _mm_loadu_ps(s + 8), r3 = _mm_loadu_ps(s + 12);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(c[0] + i, r0);
+                _mm_storeu_ps(c[1] + i, r1);
+                _mm_storeu_ps(c[2] + i, r2);
+                _mm_storeu_ps(c[3] + i, r3);
+            }
+        }
+
+        if (bytes == 4 && channels == 6) {
+            float* c[6];
+            for (int j = 0; j < 6; j++)
+                c[j] = (float*)dst[j] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                const float* s  = (const float*)(src + i * 24);
+                __m128       v0 = _mm_loadu_ps(s), v1 = _mm_loadu_ps(s + 4);
+                __m128       v2 = _mm_loadu_ps(s + 8), v3 = _mm_loadu_ps(s + 12);
+                __m128       v4 = _mm_loadu_ps(s + 16), v5 = _mm_loadu_ps(s + 20);
+                // Channels 0-3 of each frame
+                __m128 r0 = v0, r1 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 0, 3, 2));
+                __m128 r2 = v3, r3 = _mm_shuffle_ps(v4, v5, _MM_SHUFFLE(1, 0, 3, 2));
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                // Channels 4-5 of frames 0, 2 and 1, 3
+                __m128 h0 = _mm_movelh_ps(v1, v4), h1 = _mm_movehl_ps(v5, v2);
+                h0 = _mm_shuffle_ps(h0, h0, _MM_SHUFFLE(3, 1, 2, 0));
+                h1 = _mm_shuffle_ps(h1, h1, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_ps(c[0] + i, r0);
+                _mm_storeu_ps(c[1] + i, r1);
+                _mm_storeu_ps(c[2] + i, r2);
+                _mm_storeu_ps(c[3] + i, r3);
+                _mm_storeu_ps(c[4] + i, _mm_unpacklo_ps(h0, h1));
+                _mm_storeu_ps(c[5] + i, _mm_unpackhi_ps(h0, h1));
+            }
+        }
+
+        if (bytes == 4 && channels == 8) {
+            float* c[8];
+            for (int j = 0; j < 8; j++)
+                c[j] = (float*)dst[j] + offset;
+            for (; i + 4 <= frames; i += 4) {
+                const float* s  = (const float*)(src + i * 32);
+                __m128       l0 = _mm_loadu_ps(s), h0 = _mm_loadu_ps(s + 4);
+                __m128       l1 = _mm_loadu_ps(s + 8), h1 = _mm_loadu_ps(s + 12);
+                __m128       l2 = _mm_loadu_ps(s + 16), h2 = _mm_loadu_ps(s + 20);
+                __m128       l3 = _mm_loadu_ps(s + 24), h3 = _mm_loadu_ps(s + 28);
+                _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+                _MM_TRANSPOSE4_PS(h0, h1, h2, h3);
+                _mm_storeu_ps(c[0] + i, l0);
+                _mm_storeu_ps(c[1] + i, l1);
+                _mm_storeu_ps(c[2] + i, l2);
+                _mm_storeu_ps(c[3] + i, l3);
+                _mm_storeu_ps(c[4] + i, h0);
+                _mm_storeu_ps(c[5] + i, h1);
+                _mm_storeu_ps(c[6] + i, h2);
+                _mm_storeu_ps(c[7] + i, h3);
+            }
+        }
+
+        if (bytes == 8 && channels == 2) {
+            int64_t* c0 = (int64_t*)dst[0] + offset;
+            int64_t* c1 = (int64_t*)dst[1] + offset;
+            for (; i + 2 <= frames; i += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(src + i * 16));
+                __m128i b = _mm_loadu_si128((const __m128i*)(src + i * 16 + 16));
+                _mm_storeu_si128((__m128i*)(c0 + i), _mm_unpacklo_epi64(a, b));
+                _mm_storeu_si128((__m128i*)(c1 + i), _mm_unpackhi_epi64(a, b));
+            }
+        }
+
+        return i;
+    }
+#endif
+
+#ifdef WAV_AVX2
+    WAV_TARGET_AVX2
+    static size_t deinterleaveAVX2(const uint8_t* src, void* const* dst, size_t offset,
+                                   size_t frames, uint32_t channels, uint32_t bytes) {
+        size_t i = 0;
+
+        if (bytes == 2 && channels == 2) {
+            int16_t* c0 = (int16_t*)dst[0] + offset;
+            int16_t* c1 = (int16_t*)dst[1] + offset;
+            for (; i + 16 <= frames; i += 16) {
+                __m256i a  = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+                __m256i b  = _mm256_loadu_si256((const __m256i*)(src + i * 4 + 32));
+                __m256i la = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+                __m256i lb = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+                __m256i l  = _mm256_packs_epi32(la, lb);
+                __m256i r  = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+                // Packing works per 128-bit lane, restore frame order
+                _mm256_storeu_si256((__m256i*)(c0 + i), _mm256_permute4x64_epi64(l, _MM_SHUFFLE(3, 1, 2, 0)));
+                _mm256_storeu_si256((__m256i*)(c1 + i), _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+        }
+
+        if (bytes == 4 && channels == 2) {
+            float* c0 = (float*)dst[0] + offset;
+            float* c1 = (float*)dst[1] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                const float* s = (const float*)(src + i * 8);
+                __m256       a = _mm256_loadu_ps(s), b = _mm256_loadu_ps(s + 8);
+                __m256d      l = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m256d      r = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                _mm256_storeu_ps(c0 + i, _mm256_castpd_ps(_mm256_permute4x64_pd(l, _MM_SHUFFLE(3, 1, 2, 0))));
+                _mm256_storeu_ps(c1 + i, _mm256_castpd_ps(_mm256_permute4x64_pd(r, _MM_SHUFFLE(3, 1, 2, 0))));
+            }
+        }
+
+        if (bytes == 4 && channels == 4) {
+            float* c[4];
+            for (int j = 0; j < 4; j++)
+                c[j] = (float*)dst[j] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                const float* s  = (const float*)(src + i * 16);
+                __m256       r0 = _mm256_loadu_ps(s), r1 = _mm256_loadu_ps(s + 8);
+                __m256       r2 = _mm256_loadu_ps(s + 16), r3 = _mm256_loadu_ps(s + 24);
+                // Pair frames i and i + 4 in the two lanes, then transpose per lane
+                __m256 a0 = _mm256_permute2f128_ps(r0, r2, 0x20);
+                __m256 a1 = _mm256_permute2f128_ps(r0, r2, 0x31);
+                __m256 a2 = _mm256_permute2f128_ps(r1, r3, 0x20);
+                __m256 a3 = _mm256_permute2f128_ps(r1, r3, 0x31);
+                __m256 t0 = _mm256_unpacklo_ps(a0, a1), t1 = _mm256_unpackhi_ps(a0, a1);
+                __m256 t2 = _mm256_unpacklo_ps(a2, a3), t3 = _mm256_unpackhi_ps(a2, a3);
+                _mm256_storeu_ps(c[0] + i, _mm256_shuffle_ps(t0, t2, 0x44));
+                _mm256_storeu_ps(c[1] + i, _mm256_shuffle_ps(t0, t2, 0xEE));
+                _mm256_storeu_ps(c[2] + i, _mm256_shuffle_ps(t1, t3, 0x44));
+                _mm256_storeu_ps(c[3] + i, _mm256_shuffle_ps(t1, t3, 0xEE));
+            }
+        }
+
+        if (bytes == 4 && channels == 8) {
+            float* c[8];
+            for (int j = 0; j < 8; j++)
+                c[j] = (float*)dst[j] + offset;
+            for (; i + 8 <= frames; i += 8) {
+                const float* s = (const float*)(src + i * 32);
+                __m256       r[8], t[8], u[8];
+                for (int j = 0; j < 8; j++)
+                    r[j] = _mm256_loadu_ps(s + j * 8);
+                for (int j = 0; j < 8; j += 2) {
+                    t[j]     = _mm256_unpacklo_ps(r[j], r[j + 1]);
+                    t[j + 1] = _mm256_unpackhi_ps(r[j], r[j + 1]);
+                }
+                for (int j = 0; j < 8; j += 4) {
+                    u[j]     = _mm256_shuffle_ps(t[j], t[j + 2], 0x44);
+                    u[j + 1] = _mm256_shuffle_ps(t[j], t[j + 2], 0xEE);
+                    u[j + 2] = _mm256_shuffle_ps(t[j + 1], t[j + 3], 0x44);
+                    u[j + 3] = _mm256_shuffle_ps(t[j + 1], t[j + 3], 0xEE);
+                }
+                for (int j = 0; j < 4; j++) {
+                    _mm256_storeu_ps(c[j] + i, _mm256_permute2f128_ps(u[j], u[j + 4], 0x20));
+                    _mm256_storeu_ps(c[j + 4] + i, _mm256_permute2f128_ps(u[j], u[j + 4], 0x31));
+                }
+            }
+        }
+
+        return i;
+    }
+#endif
+};
+
+// Fixed set of worker threads, each with its own task deque.
+// Workers pop their own newest task and steal the oldest from others.
+struct WavThreadPool {
+    typedef std::function<void()> Task;
+
+    explicit WavThreadPool(unsigned threads = 0)
+        : threads(threads), queued(0), next(0), stopping(false) {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        // Workers read the count and queues, so both are set before any start
+        this->threads = threads;
+        queues        = std::vector<Queue>(threads);
+        workers.reserve(threads);
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i] { run(i); });
+    }
+    WavThreadPool(const WavThreadPool& other) = delete;
+    ~WavThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // Pool shared by everything that is not given one explicitly
+    static WavThreadPool& shared() {
+        static WavThreadPool pool;
+        return pool;
+    }
+
+    unsigned size() const { return threads; }
+
+    // Queues a task. Tasks submitted from a worker go to its own deque.
+    void submit(Task task) {
+        unsigned index = current() == this ? worker() : next++ % size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // Runs fn(0) .. fn(count - 1) across the pool and returns once all are done.
+    // The calling thread works through queued tasks while it waits, so this
+    // may be called from inside a task.
+    template <typename F>
+    void parallelFor(size_t count, const F& fn) {
+        std::atomic<size_t> remaining(count);
+        for (size_t i = 1; i < count; i++)
+            submit([&fn, &remaining, i] {
+                fn(i);
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+
+        if (count != 0) {
+            fn(0);
+            remaining.fetch_sub(1, std::memory_order_release);
+        }
+
+        unsigned self = current() == this ? worker() : 0;
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            Task task;
+            if (take(self, task))
+                task();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+  private:
+    struct alignas(64) Queue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    unsigned                 threads;
+    std::vector<Queue>       queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t>      queued;
+    std::atomic<unsigned>    next;
+    std::mutex               mutex;
+    std::condition_variable  wake;
+    bool                     stopping;
+
+    static WavThreadPool*& current() {
+        static thread_local WavThreadPool* pool = nullptr;
+        return pool;
+    }
+    static unsigned& worker() {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    bool take(unsigned self, Task& task) {
+        unsigned count = size();
+        for (unsigned k = 0; k < count; k++) {
+            Queue&                      queue = queues[(self + k) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            if (k == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void run(unsigned self) {
+        current() = this;
+        worker()  = self;
+        for (;;) {
+            Task task;
+            if (take(self, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || queued != 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+};
+
+// Streaming 64-bit non-cryptographic hash for fingerprints and cache keys.
+// Input is cut into 1 MB segments that are hashed on their own and then
+// chained, so of() can hash the segments in parallel and still agree with
+// update(). Not suitable where inputs may be crafted to collide.
+struct WavHash {
+    static constexpr size_t segmentSize = 1 << 20;
+
+    WavHash() { reset(); }
+
+    void reset() {
+        chain = prime5;
+        total = 0;
+        startSegment();
+    }
+
+    void update(const void* data, size_t size) {
+        const uint8_t* src = (const uint8_t*)data;
+        total             += size;
+        while (size != 0) {
+            // Top up a partial stripe first
+            if (fill != 0 || size < stripeSize) {
+                size_t n = stripeSize - fill < size ? stripeSize - fill : size;
+                memcpy(stripe + fill, src, n);
+                fill += n;
+                src  += n;
+                size -= n;
+                if (fill == stripeSize) {
+                    fill = 0;
+                    consume(stripe, 1);
+                }
+                continue;
+            }
+
+            // Whole stripes straight from the input, up to the segment end
+            size_t room = segmentSize / stripeSize - stripes;
+            size_t n    = size / stripeSize < room ? size / stripeSize : room;
+            consume(src, n);
+            src  += n * stripeSize;
+            size -= n * stripeSize;
+        }
+    }
+
+    // Hash of everything given to update() since the last reset
+    uint64_t digest() const {
+        uint64_t result = chain;
+        if (stripes != 0 || fill != 0) {
+            uint64_t lanes[8];
+            size_t   done = stripes;
+            memcpy(lanes, acc, sizeof(lanes));
+            if (fill != 0) {
+                uint8_t last[stripeSize] = {};
+                memcpy(last, stripe, fill);
+                accumulate(lanes, done, last, 1);
+            }
+            result = link(result, finish(lanes, stripes * stripeSize + fill));
+        }
+        return avalanche(result ^ total * prime1);
+    }
+
+    // Hash of a whole buffer, the same as update() followed by digest()
+    static uint64_t of(const void* data, size_t size) { return of(data, size, nullptr); }
+
+    // Hashes the segments across the pool
+    static uint64_t of(const void* data, size_t size, WavThreadPool& pool) {
+        return of(data, size, &pool);
+    }
+
+  private:
+    static constexpr size_t   stripeSize   = 64;
+    static constexpr size_t   blockStripes = 16; // Stripes between scrambles
+    static constexpr uint64_t prime1       = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t prime2       = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t prime3       = 0x165667B19E3779F9ull;
+    static constexpr uint64_t prime4       = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t prime5       = 0x27D4EB2F165667C5ull;
+
+    // Lane keys, then scramble keys (the SHA-512 initial values and round constants)
+    static constexpr uint64_t keys[16] = {
+        0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull, 0x3C6EF372FE94F82Bull,
+        0xA54FF53A5F1D36F1ull, 0x510E527FADE682D1ull, 0x9B05688C2B3E6C1Full,
+        0x1F83D9ABFB41BD6Bull, 0x5BE0CD19137E2179ull, 0x428A2F98D728AE22ull,
+        0x7137449123EF65CDull, 0xB5C0FBCFEC4D3B2Full, 0xE9B5DBA58189DBBCull,
+        0x3956C25BF348B538ull, 0x59F111F1B605D019ull, 0x923F82A4AF194F9Bull,
+        0xAB1C5ED5DA6D8118ull,
+    };
+
+    uint64_t acc[8];
+    size_t   stripes; // Whole stripes in the current segment
+    uint8_t  stripe[stripeSize];
+    size_t   fill;    // Bytes waiting in stripe
+    uint64_t chain;   // Digests of the finished segments
+    uint64_t total;
+
+    void startSegment() {
+        for (int j = 0; j < 8; j++)
+            acc[j] = keys[15 - j];
+        stripes = 0;
+        fill    = 0;
+    }
+
+    void consume(const uint8_t* src, size_t count) {
+        accumulate(acc, stripes, src, count);
+        if (stripes == segmentSize / stripeSize) {
+            chain = link(chain, finish(acc, segmentSize));
+            startSegment();
+        }
+    }
+
+    // Accumulates count stripes, scrambling the lanes every blockStripes
+    static void accumulate(uint64_t* lanes, size_t& done, const uint8_t* src, size_t count) {
+        while (count != 0) {
+            size_t n = blockStripes - done % blockStripes;
+            n        = n < count ? n : count;
+            WavKernel::accumulate(lanes, keys, src, n);
+            done  += n;
+            src   += n * stripeSize;
+            count -= n;
+            if (done % blockStripes == 0)
+                for (int j = 0; j < 8; j++) {
+                    lanes[j] ^= lanes[j] >> 47;
+                    lanes[j] ^= keys[8 + j];
+                    lanes[j] *= 0x9E3779B1u;
+                }
+        }
+    }
+
+    static uint64_t segment(const uint8_t* src, size_t size) {
+        uint64_t lanes[8];
+        size_t   done = 0;
+        for (int j = 0; j < 8; j++)
+            lanes[j] = keys[15 - j];
+        accumulate(lanes, done, src, size / stripeSize);
+        if (size % stripeSize != 0) {
+            uint8_t last[stripeSize] = {};
+            memcpy(last, src + size / stripeSize * stripeSize, size % stripeSize);
+            accumulate(lanes, done, last, 1);
+        }
+        return finish(lanes, size);
+    }
+
+    static uint64_t of(const void* data, size_t size, WavThreadPool* pool) {
+        const uint8_t* src      = (const uint8_t*)data;
+        size_t         segments = (size + segmentSize - 1) / segmentSize;
+        uint64_t       result   = prime5;
+        if (pool == nullptr || segments < 2) {
+            for (size_t s = 0; s < segments; s++) {
+                size_t n = s + 1 < segments ? segmentSize : size - s * segmentSize;
+                result   = link(result, segment(src + s * segmentSize, n));
+            }
+            return avalanche(result ^ size * prime1);
+        }
+
+        // A few runs of whole segments per thread, chained in order afterwards
+        std::vector<uint64_t> digests(segments);
+        size_t                limit = pool->size() * 4;
+        size_t                parts = segments < limit ? segments : limit;
+        pool->parallelFor(parts, [&](size_t i) {
+            for (size_t s = segments * i / parts; s < segments * (i + 1) / parts; s++) {
+                size_t n   = s + 1 < segments ? segmentSize : size - s * segmentSize;
+                digests[s] = segment(src + s * segmentSize, n);
+            }
+        });
+        for (uint64_t digest : digests)
+            result = link(result, digest);
+        return avalanche(result ^ size * prime1);
+    }
+
+    static uint64_t rotl(uint64_t x, int r) { return x << r | x >> (64 - r); }
+
+    static uint64_t round(uint64_t x) { return rotl(x * prime2, 31) * prime1; }
+
+    static uint64_t link(uint64_t chain, uint64_t digest) {
+        return rotl(chain ^ round(digest), 27) * prime1 + prime4;
+    }
+
+    static uint64_t finish(const uint64_t* lanes, uint64_t size) {
+        uint64_t result = size * prime1;
+        for (int j = 0; j < 8; j++)
+            result = link(result, lanes[j]);
+        return avalanche(result);
+    }
+
+    static uint64_t avalanche(uint64_t x) {
+        x ^= x >> 33;
+        x *= prime2;
+        x ^= x >> 29;
+        x *= prime3;
+        x ^= x >> 32;
+        return x;
+    }
+};
+
+// Identity of a file's audio. Files that differ only in their metadata
+// chunks, or in how the format chunk spells the same format, are equal.
+struct WavFingerprint {
+    uint64_t data;   // WavHash of the data chunk payload
+    uint64_t format; // Hash of the sample type, bits, channels and rate
+
+    bool operator==(const WavFingerprint& other) const {
+        return data == other.data && format == other.format;
+    }
+    bool operator!=(const WavFingerprint& other) const { return !(*this == other); }
+};
+
+// Planar sample buffer owning one 64-byte aligned block:
+// the channel pointer table followed by every channel.
+template <typename T>
+struct WavData {
+    uint32_t     channels;
+    size_t       samples;
+    T**          data;
+    size_t       stride; // Elements from the start of one channel to the next
+    WavAllocator allocator;
+
+    WavData()
+        : channels(0), samples(0), data(nullptr), stride(0), allocator(WavAllocator::heap()) {}
+    WavData(uint32_t channels, size_t samples,
+            const WavAllocator& allocator = WavAllocator::heap())
+        : channels(channels), samples(samples), data(nullptr), stride(0),
+          allocator(allocator) {
+        // Pad channels to whole cache lines. A stride that is a multiple of
+        // the page size maps the same sample of every channel to the same
+        // cache set, so move those one line further.
+        size_t table = (channels * sizeof(T*) + 63) & ~(size_t)63;
+        size_t bytes = (samples * sizeof(T) + 63) & ~(size_t)63;
+        if (bytes % 4096 == 0)
+            bytes += 64;
+        stride = bytes / sizeof(T);
+
+        void* block = allocator.allocate(table + channels * bytes, 64);
+        if (block == nullptr) {
+            this->channels = 0;
+            this->samples  = 0;
+            return;
+        }
+
+        data = (T**)block;
+        for (uint32_t i = 0; i < channels; i++)
+            data[i] = (T*)((uint8_t*)block + table + i * bytes);
+    }
+
+    WavData(const WavData& other)            = delete;
+    WavData& operator=(const WavData& other) = delete;
+    WavData(WavData&& other)
+        : channels(other.channels), samples(other.samples), data(other.data),
+          stride(other.stride), allocator(other.allocator) {
+        other.channels = 0;
+        other.samples  = 0;
+        other.data     = nullptr;
+        other.stride   = 0;
+    }
+    WavData& operator=(WavData&& other) {
+        if (this != &other) {
+            free();
+            channels       = other.channels;
+            samples        = other.samples;
+            data           = other.data;
+            stride         = other.stride;
+            allocator      = other.allocator;
+            other.channels = 0;
+            other.samples  = 0;
+            other.data     = nullptr;
+            other.stride   = 0;
+        }
+        return *this;
+    }
+
+    ~WavData() { free(); }
+
+    void free() {
+        // The pointer table heads the block
+        allocator.release(data);
+        channels = 0;
+        samples  = 0;
+        data     = nullptr;
+        stride   = 0;
+    }
+};
+
+// Random access iterator over every step-th element from base, for walking
+// one channel of interleaved frames. Step is fixed at compile time unless 0.
+template <typename T, uint32_t Step = 0>
+struct WavStrideIterator {
+    typedef std::random_access_iterator_tag      iterator_category;
+    typedef typename std::remove_const<T>::type value_type;
+    typedef ptrdiff_t                            difference_type;
+    typedef T*                                   pointer;
+    typedef T&                                   reference;
+
+    T*       base;
+    size_t   index;
+    uint32_t step; // Used when Step is 0
+
+    WavStrideIterator() : base(nullptr), index(0), step(Step) {}
+    WavStrideIterator(T* base, size_t index, uint32_t step)
+        : base(base), index(index), step(Step != 0 ? Step : step) {}
+
+    size_t stride() const { return Step != 0 ? Step : step; }
+
+    T& operator*() const { return base[index * stride()]; }
+    T* operator->() const { return &base[index * stride()]; }
+    T& operator[](ptrdiff_t n) const { return base[(index + n) * stride()]; }
+
+    WavStrideIterator& operator++() { index++; return *this; }
+    WavStrideIterator& operator--() { index--; return *this; }
+    WavStrideIterator  operator++(int) { WavStrideIterator it = *this; index++; return it; }
+    WavStrideIterator  operator--(int) { WavStrideIterator it = *this; index--; return it; }
+    WavStrideIterator& operator+=(ptrdiff_t n) { index += n; return *this; }
+    WavStrideIterator& operator-=(ptrdiff_t n) { index -= n; return *this; }
+    WavStrideIterator  operator+(ptrdiff_t n) const { return {base, index + n, step}; }
+    WavStrideIterator  operator-(ptrdiff_t n) const { return {base, index - n, step}; }
+    friend WavStrideIterator operator+(ptrdiff_t n, const WavStrideIterator& it) { return it + n; }
+
+    ptrdiff_t operator-(const WavStrideIterator& other) const {
+        return (ptrdiff_t)(index - other.index);
+    }
+    bool operator==(const WavStrideIterator& other) const { return index == other.index; }
+    bool operator!=(const WavStrideIterator& other) const { return index != other.index; }
+    bool operator<(const WavStrideIterator& other) const { return index < other.index; }
+    bool operator>(const WavStrideIterator& other) const { return index > other.index; }
+    bool operator<=(const WavStrideIterator& other) const { return index <= other.index; }
+    bool operator>=(const WavStrideIterator& other) const { return index >= other.index; }
+};
+
+// Typed view of interleaved frames that owns nothing, e.g. over Data.data.
+// Channels fixes the channel count at compile time, 0 takes it at run time.
+// Use a const T for read-only views.
+template <typename T, uint32_t Channels = 0>
+struct WavView {
+    // Every sample of one channel
+    struct Channel {
+        typedef WavStrideIterator<T, Channels> iterator;
+
+        T*       base;
+        size_t   frames;
+        uint32_t step;
+
+        iterator begin() const { return {base, 0, step}; }
+        iterator end() const { return {base, frames, step}; }
+        size_t   size() const { return frames; }
+        T&       operator[](size_t i) const { return base[i * (Channels != 0 ? Channels : step)]; }
+    };
+
+    // Every channel of one frame
+    struct Frame {
+        T*       data;
+        uint32_t channels;
+
+        T*     begin() const { return data; }
+        T*     end() const { return data + channels; }
+        size_t size() const { return channels; }
+        T&     operator[](uint32_t c) const { return data[c]; }
+    };
+
+    struct FrameIterator {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Frame                           value_type;
+        typedef ptrdiff_t                       difference_type;
+        typedef const Frame*                    pointer;
+        typedef Frame                           reference;
+
+        T*       base;
+        size_t   index;
+        uint32_t channels;
+
+        Frame operator*() const { return {base + index * channels, channels}; }
+        Frame operator[](ptrdiff_t n) const { return {base + (index + n) * channels, channels}; }
+
+        FrameIterator& operator++() { index++; return *this; }
+        FrameIterator& operator--() { index--; return *this; }
+        FrameIterator  operator++(int) { FrameIterator it = *this; index++; return it; }
+        FrameIterator  operator--(int) { FrameIterator it = *this; index--; return it; }
+        FrameIterator& operator+=(ptrdiff_t n) { index += n; return *this; }
+        FrameIterator& operator-=(ptrdiff_t n) { index -= n; return *this; }
+        FrameIterator  operator+(ptrdiff_t n) const { return {base, index + n, channels}; }
+        FrameIterator  operator-(ptrdiff_t n) const { return {base, index - n, channels}; }
+
+        ptrdiff_t operator-(const FrameIterator& other) const {
+            return (ptrdiff_t)(index - other.index);
+        }
+        bool operator==(const FrameIterator& other) const { return index == other.index; }
+        bool operator!=(const FrameIterator& other) const { return index != other.index; }
+        bool operator<(const FrameIterator& other) const { return index < other.index; }
+    };
+
+    T*       data;
+    size_t   frames;
+    uint32_t channels;
+
+    WavView() : data(nullptr), frames(0), channels(Channels) {}
+    WavView(T* data, size_t frames, uint32_t channels = Channels)
+        : data(data), frames(frames), channels(Channels != 0 ? Channels : channels) {}
+    WavView(void* data, size_t frames, uint32_t channels = Channels)
+        : WavView((T*)data, frames, channels) {}
+
+    bool empty() const { return frames == 0; }
+
+    Channel channel(uint32_t c) const { return {data + c, frames, channels}; }
+    Frame   frame(size_t i) const { return {data + i * channels, channels}; }
+    Frame   operator[](size_t i) const { return frame(i); }
+    T&      at(size_t frame, uint32_t channel) const { return data[frame * channels + channel]; }
+
+    FrameIterator begin() const { return {data, 0, channels}; }
+    FrameIterator end() const { return {data, frames, channels}; }
+
+    // Every sample of every channel, in file order
+    T* samplesBegin() const { return data; }
+    T* samplesEnd() const { return data + frames * channels; }
+};
+
+// Converts planar float between two sample rates by the reduced ratio
+// up / down, with a polyphase bank of Kaiser-windowed sinc filters computed
+// once in open(). Input can arrive in blocks of any size: every call carries
+// on from the previous one, keeping the input the filter still needs.
+struct WavResampler {
+    uint32_t channels;
+    uint32_t inRate;
+    uint32_t outRate;
+
+  private:
+    WavAllocator allocator;
+    uint32_t     up;       // Phases, outRate / gcd
+    uint32_t     down;     // Input step, inRate / gcd
+    uint32_t     taps;     // Coefficients per phase, a multiple of 8
+    float*       bank;     // up * taps coefficients
+    float**      history;  // Input per channel, the pointer table heads the block
+    size_t       capacity; // Frames each history buffer holds
+    size_t       pending;  // Frames in the history buffers
+    size_t       index;    // First history frame under the filter
+    uint32_t     phase;    // Position of the next output between index and index + 1, in 1 / up
+    uint64_t     consumed; // Input frames since the stream started
+    uint64_t     produced; // Output frames since the stream started
+
+  public:
+    WavResampler(const WavAllocator& allocator = WavAllocator::heap())
+        : channels(0), inRate(0), outRate(0), allocator(allocator), up(1), down(1), taps(0),
+          bank(nullptr), history(nullptr), capacity(0), pending(0), index(0), phase(0),
+          consumed(0), produced(0) {}
+    WavResampler(const WavResampler& other) = delete;
+    ~WavResampler() { close(); }
+
+    // Builds the filter bank. quality is the number of zero crossings of the
+    // sinc on each side; longer filters cut off more sharply and cost more.
+    // Returns false for zero rates or channels, or when allocation fails.
+    bool open(uint32_t channels, uint32_t inRate, uint32_t outRate, uint32_t quality = 16) {
+        close();
+        if (channels == 0 || inRate == 0 || outRate == 0 || quality == 0)
+            return false;
+
+        uint32_t a = inRate, b = outRate;
+        while (b != 0) {
+            uint32_t r = a % b;
+            a          = b;
+            b          = r;
+        }
+        up   = outRate / a;
+        down = inRate / a;
+
+        // Cut off just below the lower of the two Nyquist frequencies,
+        // widening the filter by the same factor when downsampling
+        double cutoff = 0.95 * (up < down ? (double)up / down : 1.0);
+        taps          = ((uint32_t)ceil(2 * quality / cutoff) + 7) & ~7u;
+
+        bank = (float*)allocator.allocate((size_t)up * taps * sizeof(float), 64);
+        if (bank == nullptr)
+            return false;
+
+        const double beta   = 8.6;
+        const double half   = taps / 2;
+        const double window = besselI0(beta);
+        for (uint32_t p = 0; p < up; p++) {
+            float* h   = bank + (size_t)p * taps;
+            double sum = 0;
+            for (uint32_t k = 0; k < taps; k++) {
+                // Distance from the input sample to the output position
+                double t = k - (half - 1) - (double)p / up;
+                double x = cutoff * t * M_PI;
+                double s = x == 0 ? 1 : sin(x) / x;
+                double w = t / half;
+                w        = w * w < 1 ? besselI0(beta * sqrt(1 - w * w)) / window : 0;
+                h[k]     = (float)(s * w);
+                sum     += s * w;
+            }
+            // Unity gain at DC for every phase
+            for (uint32_t k = 0; k < taps; k++)
+                h[k] = (float)(h[k] / sum);
+        }
+
+        this->channels = channels;
+        this->inRate   = inRate;
+        this->outRate  = outRate;
+        if (!reserve(4096)) {
+            close();
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void close() {
+        allocator.release(bank);
+        allocator.release(history);
+        bank     = nullptr;
+        history  = nullptr;
+        capacity = 0;
+        channels = 0;
+        taps     = 0;
+    }
+
+    // Drops buffered input and starts a new stream
+    void reset() {
+        // Half a filter of silence in front of the first sample
+        // lines the first output up with it
+        pending  = taps / 2 - 1;
+        index    = 0;
+        phase    = 0;
+        consumed = 0;
+        produced = 0;
+        for (uint32_t c = 0; c < channels; c++)
+            memset(history[c], 0, pending * sizeof(float));
+    }
+
+    // Frames a stream of the given length converts to, including the flush
+    uint64_t outputFrames(uint64_t inputFrames) const {
+        return (inputFrames * up + down - 1) / down;
+    }
+
+    // Upper bound on the frames process() or flush() may write for frames
+    // more input frames
+    size_t maxOutput(size_t frames) const {
+        return (size_t)(((uint64_t)pending + frames + taps / 2) * up / down) + 1;
+    }
+
+    // Converts frames input frames src[c][0] onwards, writing every output
+    // frame the filter can complete to dst[c][offset] onwards. dst holds
+    // room for maxOutput(frames). Returns the number of frames written.
+    size_t process(const float* const* src, size_t frames, float** dst, size_t offset = 0) {
+        if (bank == nullptr || !reserve(pending + frames))
+            return 0;
+
+        for (uint32_t c = 0; c < channels; c++)
+            memcpy(history[c] + pending, src[c], frames * sizeof(float));
+        pending  += frames;
+        consumed += frames;
+        return run(dst, offset, (uint64_t)-1);
+    }
+
+    // Completes the stream, writing the output still held back by the filter,
+    // and resets for the next one. Returns the number of frames written.
+    size_t flush(float** dst, size_t offset = 0) {
+        if (bank == nullptr)
+            return 0;
+
+        size_t tail = taps / 2;
+        if (!reserve(pending + tail))
+            return 0;
+        for (uint32_t c = 0; c < channels; c++)
+            memset(history[c] + pending, 0, tail * sizeof(float));
+        pending += tail;
+
+        size_t done = run(dst, offset, outputFrames(consumed) - produced);
+        reset();
+        return done;
+    }
+
+    // Converts a whole buffer at once
+    static WavData<float> resample(const WavData<float>& data, uint32_t inRate,
+                                   uint32_t outRate, uint32_t quality = 16) {
+        WavResampler resampler(data.allocator);
+        if (!resampler.open(data.channels, inRate, outRate, quality))
+            return {};
+
+        WavData<float> out(data.channels, resampler.outputFrames(data.samples), data.allocator);
+        if (out.data == nullptr)
+            return {};
+
+        size_t done = resampler.process(data.data, data.samples, out.data);
+        resampler.flush(out.data, done);
+        return out;
+    }
+
+  private:
+    static double besselI0(double x) {
+        double sum = 1, term = 1;
+        for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum  += term;
+        }
+        return sum;
+    }
+
+    // Grows the history buffers to hold at least frames
+    bool reserve(size_t frames) {
+        if (frames <= capacity)
+            return true;
+
+        size_t size  = capacity * 2 > frames ? capacity * 2 : frames;
+        size_t table = (channels * sizeof(float*) + 63) & ~(size_t)63;
+        size_t bytes = (size * sizeof(float) + 63) & ~(size_t)63;
+        void*  block = allocator.allocate(table + channels * bytes, 64);
+        if (block == nullptr)
+            return false;
+
+        float** buffers = (float**)block;
+        for (uint32_t c = 0; c < channels; c++) {
+            buffers[c] = (float*)((uint8_t*)block + table + c * bytes);
+            if (history != nullptr)
+                memcpy(buffers[c], history[c], pending * sizeof(float));
+        }
+        allocator.release(history);
+        history  = buffers;
+        capacity = bytes / sizeof(float);
+        return true;
+    }
+
+    // Writes up to limit output frames, then drops the input no longer needed
+    size_t run(float** dst, size_t offset, uint64_t limit) {
+        // Count the outputs first, so each channel runs through its own
+        // history in one pass
+        size_t   count = 0;
+        size_t   start = index;
+        uint32_t first = phase;
+        while (index + taps <= pending && count < limit) {
+            count++;
+            phase += down;
+            index += phase / up;
+            phase %= up;
+        }
+
+        for (uint32_t c = 0; c < channels; c++) {
+            const float* in  = history[c];
+            float*       out = dst[c] + offset;
+            size_t       i   = start;
+            uint32_t     p   = first;
+            for (size_t n = 0; n < count; n++) {
+                out[n]  = WavKernel::dot(in + i, bank + (size_t)p * taps, taps);
+                p      += down;
+                i      += p / up;
+                p      %= up;
+            }
+        }
+        produced += count;
+
+        size_t drop = index < pending ? index : pending;
+        for (uint32_t c = 0; c < channels; c++)
+            memmove(history[c], history[c] + drop, (pending - drop) * sizeof(float));
+        pending -= drop;
+        index   -= drop;
+        return count;
+    }
+};
+
+// Channel remix applied while decoding. Output channel o is the sum of every
+// input channel c scaled by gains[o * inputs + c], which covers downmixes as
+// well as picking and reordering channels.
+struct WavMix {
+    uint32_t           inputs;
+    uint32_t           outputs;
+    std::vector<float> gains; // One row of inputs gains per output
+
+    WavMix() : inputs(0), outputs(0) {}
+    WavMix(uint32_t inputs, uint32_t outputs, const float* gains = nullptr)
+        : inputs(inputs), outputs(outputs), gains((size_t)inputs * outputs, 0.f) {
+        if (gains != nullptr)
+            memcpy(this->gains.data(), gains, this->gains.size() * sizeof(float));
+    }
+
+    float* row(uint32_t output) { return gains.data() + (size_t)output * inputs; }
+    const float* row(uint32_t output) const { return gains.data() + (size_t)output * inputs; }
+
+    // Output o is input channel channels[o]
+    static WavMix select(uint32_t inputs, const uint32_t* channels, uint32_t count) {
+        WavMix mix(inputs, count);
+        for (uint32_t o = 0; o < count; o++)
+            if (channels[o] < inputs)
+                mix.row(o)[channels[o]] = 1;
+        return mix;
+    }
+
+    // Folds inputs down to outputs channels. 5.1 to stereo follows ITU-R
+    // BS.775 (centre and surrounds at -3 dB, LFE dropped), anything else
+    // sends input c to output c % outputs. Rows are scaled to a total gain
+    // of 1 so the result can not clip.
+    static WavMix downmix(uint32_t inputs, uint32_t outputs) {
+        WavMix mix(inputs, outputs);
+        if (outputs == 0)
+            return mix;
+
+        if (inputs == 6 && outputs == 2) {
+            const float half = 0.70710678f;
+            float       fl[] = {1, 0, half, 0, half, 0};
+            float       fr[] = {0, 1, half, 0, 0, half};
+            memcpy(mix.row(0), fl, sizeof(fl));
+            memcpy(mix.row(1), fr, sizeof(fr));
+        } else {
+            for (uint32_t c = 0; c < inputs; c++)
+                mix.row(c % outputs)[c] = 1;
+            // Fewer inputs than outputs: repeat them
+            for (uint32_t o = inputs; o < outputs && inputs != 0; o++)
+                mix.row(o)[o % inputs] = 1;
+        }
+
+        for (uint32_t o = 0; o < outputs; o++) {
+            float* gains = mix.row(o);
+            float  sum   = 0;
+            for (uint32_t c = 0; c < inputs; c++)
+                sum += gains[c];
+            for (uint32_t c = 0; sum > 0 && c < inputs; c++)
+                gains[c] /= sum;
+        }
+        return mix;
+    }
+};
+
+// Min, max and RMS of every channel over blocks of 2^blockShift frames,
+// then over each power-of-two multiple of that up to a single block.
+// Built in one streaming pass, after which any stretch of the file can be
+// drawn at any width without touching the samples again. Serializes to a
+// compact 'ovw ' chunk, stored in the file or as a sidecar.
+struct WavOverview {
+    static constexpr const uint8_t OVW[4] = {'o', 'v', 'w', ' '};
+
+    struct Peak {
+        float min;
+        float max;
+        float rms;
+    };
+
+    uint32_t                       channels;
+    uint32_t                       blockShift; // Level 0 blocks hold 2^blockShift frames
+    uint64_t                       frames;
+    std::vector<std::vector<Peak>> levels; // levels[k][block * channels + c], blocks double per level
+
+  private:
+    std::vector<float>  lo; // Partial block of each channel
+    std::vector<float>  hi;
+    std::vector<double> squares;
+    uint64_t            fill; // Frames in the partial block
+
+  public:
+    WavOverview() : channels(0), blockShift(0), frames(0), fill(0) {}
+
+    // Starts an empty overview
+    void reset(uint32_t channels, uint32_t blockShift = 8) {
+        this->channels   = channels;
+        this->blockShift = blockShift < 32 ? blockShift : 31;
+        frames           = 0;
+        fill             = 0;
+        levels.assign(1, std::vector<Peak>());
+        lo.assign(channels, INFINITY);
+        hi.assign(channels, -INFINITY);
+        squares.assign(channels, 0);
+    }
+
+    // Adds count frames of planar float, src[c][0] onwards
+    void add(const float* const* src, size_t count) {
+        uint64_t block = (uint64_t)1 << blockShift;
+        for (size_t done = 0; done < count;) {
+            size_t n = count - done;
+            if (n > block - fill)
+                n = (size_t)(block - fill);
+
+            for (uint32_t c = 0; c < channels; c++)
+                WavKernel::peaks(src[c] + done, n, lo[c], hi[c], squares[c]);
+            fill   += n;
+            frames += n;
+            done   += n;
+            if (fill == block)
+                closeBlock();
+        }
+    }
+
+    // Closes the last partial block and builds the coarser levels
+    void finish() {
+        if (fill != 0)
+            closeBlock();
+
+        levels.resize(1);
+        for (uint32_t k = 0; levels[k].size() > channels; k++) {
+            const std::vector<Peak>& fine   = levels[k];
+            size_t                   blocks = fine.size() / channels;
+            std::vector<Peak>        coarse((blocks + 1) / 2 * channels);
+            for (size_t b = 0; b < blocks; b += 2)
+                for (uint32_t c = 0; c < channels; c++) {
+                    const Peak* a = &fine[b * channels + c];
+                    const Peak* z = b + 1 < blocks ? a + channels : a;
+                    coarse[b / 2 * channels + c] =
+                        merge(*a, blockFrames(k, b), *z, b + 1 < blocks ? blockFrames(k, b + 1) : 0);
+                }
+            levels.push_back(std::move(coarse));
+        }
+    }
+
+    // Frames covered by one block of a level
+    uint64_t blockSize(uint32_t level) const { return (uint64_t)1 << (blockShift + level); }
+
+    // Summarizes frames [start, end) of a channel into pixels columns. Each
+    // column comes from the coarsest level with blocks no wider than it, so
+    // every column merges at most three entries. Columns narrower than a
+    // level 0 block repeat its entry.
+    void render(uint32_t channel, uint64_t start, uint64_t end, Peak* out, size_t pixels) const {
+        if (end > frames)
+            end = frames;
+        for (size_t p = 0; p < pixels; p++) {
+            out[p] = {0, 0, 0};
+            if (channel >= channels || start >= end)
+                continue;
+
+            uint64_t f0 = start + (end - start) * p / pixels;
+            uint64_t f1 = start + (end - start) * (p + 1) / pixels;
+            if (f1 <= f0)
+                f1 = f0 + 1;
+
+            uint32_t level = 0;
+            while (level + 1 < levels.size() && blockSize(level + 1) <= f1 - f0)
+                level++;
+
+            const std::vector<Peak>& entries = levels[level];
+            uint32_t                 shift   = blockShift + level;
+            uint64_t                 blocks  = entries.size() / channels;
+            uint64_t                 first   = f0 >> shift;
+            uint64_t                 last    = ((f1 - 1) >> shift) + 1;
+            if (last > blocks)
+                last = blocks;
+            if (first >= last)
+                continue; // Blocks not closed by finish() yet
+
+            Peak     peak  = entries[first * channels + channel];
+            uint64_t count = blockFrames(level, first);
+            for (uint64_t b = first + 1; b < last; b++) {
+                uint64_t n = blockFrames(level, b);
+                peak       = merge(peak, count, entries[b * channels + channel], n);
+                count     += n;
+            }
+            out[p] = peak;
+        }
+    }
+
+    // Payload of the 'ovw ' chunk: a 16 byte header, then every level from
+    // the finest with min, max and RMS of each channel as 16-bit fractions
+    std::vector<uint8_t> serialize() const {
+        size_t entries = 0;
+        for (const std::vector<Peak>& level : levels)
+            entries += level.size();
+
+        std::vector<uint8_t> out(16 + entries * 6);
+        uint16_t             version = 1, count = (uint16_t)channels;
+        uint8_t              shift = (uint8_t)blockShift, depth = (uint8_t)levels.size();
+        memcpy(&out[0], &version, 2);
+        memcpy(&out[2], &count, 2);
+        out[4] = shift;
+        out[5] = depth;
+        memcpy(&out[8], &frames, 8);
+
+        int16_t* q = (int16_t*)&out[16];
+        for (const std::vector<Peak>& level : levels)
+            for (const Peak& peak : level) {
+                *q++ = quantize(peak.min);
+                *q++ = quantize(peak.max);
+                *q++ = quantize(peak.rms);
+            }
+        return out;
+    }
+
+    WavError deserialize(const void* data, size_t size) {
+        const uint8_t* in = (const uint8_t*)data;
+        uint16_t       version, count;
+        if (size < 16)
+            return INVALID_DESCRIPTOR;
+        memcpy(&version, in, 2);
+        memcpy(&count, in + 2, 2);
+        if (version != 1 || count == 0 || in[4] >= 32 || in[5] == 0)
+            return INVALID_DESCRIPTOR;
+
+        reset(count, in[4]);
+        memcpy(&frames, in + 8, 8);
+        levels.assign(in[5], std::vector<Peak>());
+
+        size_t offset = 16;
+        for (uint32_t k = 0; k < levels.size(); k++) {
+            uint64_t blocks = k + blockShift < 64 ? (frames + blockSize(k) - 1) >> (blockShift + k) : 1;
+            if (blocks > (size - offset) / (6 * channels))
+                return INVALID_DESCRIPTOR;
+
+            levels[k].resize(blocks * channels);
+            for (Peak& peak : levels[k]) {
+                int16_t q[3];
+                memcpy(q, in + offset, 6);
+                peak    = {q[0] / 32767.f, q[1] / 32767.f, q[2] / 32767.f};
+                offset += 6;
+            }
+        }
+        return SUCCESS;
+    }
+
+    // Sidecar file holding the 'ovw ' chunk on its own
+    WavError save(const char* path) const {
+        FILE* file = fopen(path, "wb");
+        if (file == nullptr)
+            return IO_ERROR;
+
+        std::vector<uint8_t> payload = serialize();
+        uint32_t             size    = (uint32_t)payload.size();
+        bool ok = writeFile(&OVW, file) && writeFile(&size, file) &&
+                  writeFile(payload.data(), payload.size(), file);
+        return fclose(file) == 0 && ok ? SUCCESS : IO_ERROR;
+    }
+
+    WavError load(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr)
+            return IO_ERROR;
+
+        uint8_t  tag[4];
+        uint32_t size;
+        if (!readFile(&tag, file) || !readFile(&size, file) || memcmp(tag, OVW, 4) != 0) {
+            fclose(file);
+            return INVALID_DESCRIPTOR;
+        }
+
+        std::vector<uint8_t> payload(size);
+        bool                 ok = size == 0 || readFile(payload.data(), size, file) == 1;
+        fclose(file);
+        return ok ? deserialize(payload.data(), size) : IO_ERROR;
+    }
+
+  private:
+    // Frames in block b of a level, only the last one may be short
+    uint64_t blockFrames(uint32_t level, uint64_t b) const {
+        uint64_t start = b << (blockShift + level);
+        uint64_t size  = blockSize(level);
+        return start + size <= frames ? size : frames > start ? frames - start : 0;
+    }
+
+    static Peak merge(const Peak& a, uint64_t na, const Peak& b, uint64_t nb) {
+        if (nb == 0)
+            return a;
+        double power = ((double)a.rms * a.rms * na + (double)b.rms * b.rms * nb) / (na + nb);
+        return {a.min < b.min ? a.min : b.min, a.max > b.max ? a.max : b.max,
+                (float)sqrt(power)};
+    }
+
+    static int16_t quantize(float x) {
+        x = x > -1 ? x : -1; // NaN becomes -1
+        x = x < 1 ? x : 1;
+        return (int16_t)lrintf(x * 32767);
+    }
+
+    void closeBlock() {
+        for (uint32_t c = 0; c < channels; c++) {
+            levels[0].push_back({lo[c], hi[c], (float)sqrt(squares[c] / fill)});
+            lo[c]      = INFINITY;
+            hi[c]      = -INFINITY;
+            squares[c] = 0;
+        }
+        fill = 0;
+    }
+};
+
+struct WavFile {
+    static constexpr const uint8_t RIFF[4] = {'R', 'I', 'F', 'F'};
+    static constexpr const uint8_t WAVE[4] = {'W', 'A', 'V', 'E'};
+    static constexpr const uint8_t fmt[4]  = {'f', 'm', 't', ' '};
+
+  public:
+    struct Descriptor {
+        uint8_t  RIFF[4];
+        uint32_t fileSize;
+        uint8_t  WAVE[4];
+    } Descriptor;
+
+    struct Format {
+        uint8_t  FMT[4];
+        uint32_t formatSize;
+        uint16_t formatType;
+        uint16_t channels;
+        uint32_t sampleRate;
+        uint32_t byteRate;
+        uint16_t blockSize;
+        uint16_t bitsPerSample;
+    } Format;
+
+    // Bytes following the basic format, used by WAVE_FORMAT_EXTENSIBLE
+    struct Extension {
+        uint16_t size;
+        uint16_t validBitsPerSample;
+        uint32_t channelMask;
+        uint8_t  subFormat[16]; // GUID, starting with the actual format type
+    } Extension;
+
+    struct Data {
+        uint8_t  DATA[4];
+        uint64_t size;
+        void*    data;
+    } Data;
+
+    // 64-bit sizes of RF64/BW64 files, from the ds64 chunk. Zero for RIFF.
+    struct Ds64 {
+        uint64_t riffSize;
+        uint64_t dataSize;
+        uint64_t sampleCount;
+    } Ds64;
+
+    struct Chunk {
+        uint8_t  tag[4];
+        uint32_t size;
+        void*    data;
+        void     print() { printf("[Chunk '%.4s', Size %u bytes]\n", tag, size); }
+    };
+
+    struct Chunks {
+        uint32_t length;
+        Chunk*   chunks;
+
+        void print() {
+            for (int64_t i = 0; i < length; i++)
+                chunks[i].print();
+        }
+    } Chunks;
+
+    // Chunk headers recorded by probe(), hashed by tag
+    struct Index {
+        struct Entry {
+            uint8_t  tag[4];
+            uint64_t size;
+            uint64_t offset; // File position of the payload
+            void*    data;   // Payload once loaded, owned by Data or Chunks
+        };
+
+        uint32_t  length;
+        Entry*    entries;
+        uint32_t* table; // Entry number + 1 per slot, 0 when empty
+        uint32_t  mask;
+
+        // First chunk with the given tag, or null
+        Entry* find(const char* tag) const {
+            if (table == nullptr)
+                return nullptr;
+            uint32_t key;
+            memcpy(&key, tag, 4);
+            for (uint32_t slot = hash(key) & mask; table[slot] != 0; slot = (slot + 1) & mask) {
+                Entry* entry = &entries[table[slot] - 1];
+                if (memcmp(entry->tag, tag, 4) == 0)
+                    return entry;
+            }
+            return nullptr;
+        }
+
+        static uint32_t hash(uint32_t key) { return (key * 2654435769u) >> 7; }
+    } Index;
+
+    // Walks the chunks of a buffer in place, clamping them to its end
+    struct ChunkCursor {
+        const uint8_t* ptr;
+        const uint8_t* end;
+        struct Ds64    ds64;
+        uint64_t       size; // Full size of the last chunk, chunk.size may be capped
+
+        // Fills in the next chunk, with data pointing into the buffer
+        bool next(Chunk& chunk) {
+            if (ptr == nullptr || (size_t)(end - ptr) < 8)
+                return false;
+            memcpy(&chunk.tag, ptr, 4);
+            memcpy(&chunk.size, ptr + 4, 4);
+            ptr += 8;
+
+            // Clamp chunks cut off by the end of the buffer
+            size = chunkSize(ds64, chunk.tag, chunk.size);
+            if (size > (size_t)(end - ptr))
+                size = end - ptr;
+            if (size < chunk.size)
+                chunk.size = (uint32_t)size;
+
+            // Odd sized chunks are followed by a pad byte
+            chunk.data = (void*)ptr;
+            ptr       += size;
+            if (size % 2 != 0 && ptr < end)
+                ptr++;
+            return true;
+        }
+    };
+
+    // Source of Data, Chunks and the buffers returned by the conversions
+    WavAllocator Allocator;
+
+    friend struct WavStreamReader;
+    friend struct WavStreamWriter;
+    friend struct WavFrameReader;
+
+  private:
+    // Allocated length of Chunks.chunks
+    uint32_t ChunksCapacity;
+
+    // File mapping backing Data and Chunks when loaded through map()
+    struct Mapping {
+        void*  base;
+        size_t size;
+    } Mapping;
+
+    // Chunks following the format in a buffer given to parse(),
+    // which also owns Data
+    struct Buffer {
+        const uint8_t* chunks;
+        const uint8_t* end;
+    } Buffer;
+
+  public:
+    WavFile() : WavFile(WavAllocator::heap()) {}
+    explicit WavFile(const WavAllocator& allocator)
+        : Descriptor{}, Format{}, Extension{}, Data{}, Ds64{}, Chunks{}, Index{},
+          Allocator(allocator), ChunksCapacity(0),
+          Mapping{}, Buffer{} {}
+    WavFile(const WavFile& other) = delete;
+    WavFile(WavFile&& other) {
+        Descriptor           = other.Descriptor;
+        Format               = other.Format;
+        Extension            = other.Extension;
+        Data                 = other.Data;
+        other.Data.size      = 0;
+        other.Data.data      = nullptr;
+        Ds64                 = other.Ds64;
+        Chunks               = other.Chunks;
+        other.Chunks.length  = 0;
+        other.Chunks.chunks  = nullptr;
+        ChunksCapacity       = other.ChunksCapacity;
+        other.ChunksCapacity = 0;
+        Index                = other.Index;
+        other.Index          = {};
+        Allocator            = other.Allocator;
+        Mapping              = other.Mapping;
+        other.Mapping.base   = nullptr;
+        other.Mapping.size   = 0;
+        Buffer               = other.Buffer;
+        other.Buffer         = {};
+    }
+
+    ~WavFile() {
+        if (Mapping.base != nullptr) {
+            // Data and Chunks point into the mapping
+            munmap(Mapping.base, Mapping.size);
+        } else if (Buffer.end == nullptr) {
+            Allocator.release(Data.data);
+            for (int64_t i = 0; i < Chunks.length; i++)
+                Allocator.release(Chunks.chunks[i].data);
+        }
+        Allocator.release(Chunks.chunks);
+        Allocator.release(Index.entries);
+        Allocator.release(Index.table);
+    }
+
+  private:
+    // Appends to Chunks, doubling its capacity when full
+    bool appendChunk(const Chunk& chunk) {
+        if (Chunks.length == ChunksCapacity) {
+            uint32_t capacity = ChunksCapacity < 8 ? 8 : ChunksCapacity * 2;
+            Chunk*   chunks   = (Chunk*)Allocator.reallocate(
+                Chunks.chunks, sizeof(Chunk) * ChunksCapacity, sizeof(Chunk) * capacity);
+            if (chunks == nullptr)
+                return false;
+            Chunks.chunks  = chunks;
+            ChunksCapacity = capacity;
+        }
+        Chunks.chunks[Chunks.length++] = chunk;
+        return true;
+    }
+
+    // RIFF, or RF64/BW64 with the sizes in a ds64 chunk
+    static bool isDescriptor(const struct Descriptor& descriptor) {
+        if (memcmp(descriptor.WAVE, WAVE, 4) != 0)
+            return false;
+        return memcmp(descriptor.RIFF, RIFF, 4) == 0 ||
+               memcmp(descriptor.RIFF, "RF64", 4) == 0 ||
+               memcmp(descriptor.RIFF, "BW64", 4) == 0;
+    }
+
+    // Chunk size, looking up the data chunk size in ds64 when it does not fit
+    static uint64_t chunkSize(const struct Ds64& ds64, const uint8_t* tag, uint32_t size) {
+        if (size == 0xFFFFFFFF && ds64.dataSize != 0 && memcmp(tag, "data", 4) == 0)
+            return ds64.dataSize;
+        return size;
+    }
+
+    static WavError readHeader(WavFile* wavfile, FILE* file) {
+        WAV_TIME(STAGE_HEADER);
+
+        // Read Descriptor
+        readFile(&wavfile->Descriptor, file);
+        if (!isDescriptor(wavfile->Descriptor))
+            return INVALID_DESCRIPTOR;
+
+        // Find the Format, taking the 64-bit sizes from ds64
+        // and skipping padding such as JUNK in front of it
+        wavfile->Ds64 = {};
+        while (true) {
+            if (readFile(&wavfile->Format, 8, file) != 1)
+                return NO_FORMAT;
+            if (*(uint32_t*)wavfile->Format.FMT == *(uint32_t*)fmt)
+                break;
+
+            uint64_t size = wavfile->Format.formatSize + wavfile->Format.formatSize % 2;
+            if (memcmp(wavfile->Format.FMT, "ds64", 4) == 0 && size >= sizeof(Ds64)) {
+                readFile(&wavfile->Ds64, file);
+                size -= sizeof(Ds64);
+            }
+            skipFile(file, size);
+        }
+
+        // Read Format
+        readFile(&wavfile->Format.formatType, sizeof(Format) - 8, file);
+
+        // Read the format extension, seek past anything beyond it
+        if (wavfile->Format.formatSize > 16) {
+            uint32_t extension = wavfile->Format.formatSize - 16;
+            uint32_t known     = extension < sizeof(Extension) ? extension : sizeof(Extension);
+            readFile(&wavfile->Extension, known, file);
+            if (extension > known) {
+                WAV_COUNT(ioCalls, 1);
+                fseeko(file, extension - known, SEEK_CUR);
+            }
+        }
+
+        return SUCCESS;
+    }
+
+    // Reads the next chunk, with its full 64-bit size in size.
+    // A data chunk is also fed to hash when one is given.
+    static Chunk readChunk(FILE* file, const WavAllocator& allocator,
+                           const struct Ds64& ds64, uint64_t& size,
+                           WavHash* hash = nullptr) {
+        // Read Chunk Header
+        Chunk chunk;
+        readFile(&chunk.tag, file);
+        readFile(&chunk.size, file);
+
+        // Check for end-of-file or errors
+        if (feof(file) || ferror(file)) {
+            chunk.data = NULL;
+            return chunk;
+        }
+
+        // Read Chunk Data
+        WAV_TIME(STAGE_READ);
+        size       = chunkSize(ds64, chunk.tag, chunk.size);
+        chunk.data = allocator.allocate(size);
+        if (hash == nullptr || memcmp(chunk.tag, "data", 4) != 0) {
+            readFile(chunk.data, size, file);
+        } else {
+            // Hash each segment while it is still in cache
+            for (uint64_t done = 0; done < size; done += WavHash::segmentSize) {
+                size_t   n = size - done < WavHash::segmentSize ? size - done : WavHash::segmentSize;
+                uint8_t* part = (uint8_t*)chunk.data + done;
+                readFile(part, n, file);
+                hash->update(part, n);
+            }
+        }
+
+        // Step over the pad byte of odd sized chunks
+        if (size % 2 != 0) {
+            WAV_COUNT(ioCalls, 1);
+            fseeko(file, 1, SEEK_CUR);
+        }
+
+        return chunk;
+    }
+
+    static WavError seekData(WavFile* wavfile, FILE* file) {
+        WAV_TIME(STAGE_SEEK);
+
+        // Search file, skipping non-data chunks
+        // Seeking clears the end-of-file flag, so a short read of the
+        // next header is what ends the search
+        char tag[4];
+        while (true) {
+            if (readFile(&tag, file) != 1)
+                return NO_DATA;
+            if (tag[0] == 'd' && tag[1] == 'a' && tag[2] == 't' &&
+                tag[3] == 'a')
+                break; // Data chunk found
+
+            // Skip chunk
+            uint32_t size;
+            if (readFile(&size, file) != 1)
+                return NO_DATA;
+            skipFile(file, (uint64_t)size + size % 2);
+        }
+
+        // Set "data" tag
+        wavfile->Data.DATA[0] = tag[0];
+        wavfile->Data.DATA[1] = tag[1];
+        wavfile->Data.DATA[2] = tag[2];
+        wavfile->Data.DATA[3] = tag[3];
+
+        // Read Data chunk size, leaving the file at the first sample
+        uint32_t size;
+        if (readFile(&size, file) != 1)
+            return NO_DATA;
+        wavfile->Data.size = chunkSize(wavfile->Ds64, wavfile->Data.DATA, size);
+
+        return SUCCESS;
+    }
+
+    // Keeps the first data chunk in Data and appends the rest to Chunks.
+    // False when Chunks can not grow.
+    bool storeChunk(Chunk chunk, uint64_t size, bool& foundData) {
+        // (only the first) Data chunk is handled separately
+        if (!foundData && chunk.tag[0] == 'd' && chunk.tag[1] == 'a' &&
+            chunk.tag[2] == 't' && chunk.tag[3] == 'a') {
+            // Write tag
+            Data.DATA[0] = chunk.tag[0];
+            Data.DATA[1] = chunk.tag[1];
+            Data.DATA[2] = chunk.tag[2];
+            Data.DATA[3] = chunk.tag[3];
+
+            // Write size and data
+            Data.size = size;
+            Data.data = chunk.data;
+
+            foundData = true;
+            return true;
+        }
+
+        // Handle other tags
+        return appendChunk(chunk);
+    }
+
+    // Bounds-checked header of a file in memory, leaving ptr at the first
+    // chunk after the format
+    WavError parseHeader(const uint8_t*& ptr, const uint8_t* end) {
+        // Read Descriptor
+        if ((size_t)(end - ptr) < sizeof(Descriptor))
+            return INVALID_DESCRIPTOR;
+        memcpy(&Descriptor, ptr, sizeof(Descriptor));
+        ptr += sizeof(Descriptor);
+        if (!isDescriptor(Descriptor))
+            return INVALID_DESCRIPTOR;
+
+        // Find the Format, taking the 64-bit sizes from ds64
+        // and skipping padding such as JUNK in front of it
+        Ds64 = {};
+        while (true) {
+            if ((size_t)(end - ptr) < sizeof(Format))
+                return NO_FORMAT;
+            memcpy(&Format, ptr, sizeof(Format));
+            if (*(uint32_t*)Format.FMT == *(uint32_t*)fmt)
+                break;
+
+            ptr += 8;
+            if (Format.formatSize > (size_t)(end - ptr))
+                return NO_FORMAT;
+            if (memcmp(Format.FMT, "ds64", 4) == 0 && Format.formatSize >= sizeof(Ds64))
+                memcpy(&Ds64, ptr, sizeof(Ds64));
+            ptr += Format.formatSize;
+            if (Format.formatSize % 2 != 0 && ptr < end)
+                ptr++; // Pad byte
+        }
+        ptr += sizeof(Format);
+
+        // Read the format extension, skip anything beyond it
+        if (Format.formatSize > 16) {
+            size_t extension = Format.formatSize - 16;
+            if (extension > (size_t)(end - ptr))
+                extension = end - ptr;
+            memcpy(&Extension, ptr,
+                   extension < sizeof(Extension) ? extension : sizeof(Extension));
+            ptr += extension;
+        }
+
+        return SUCCESS;
+    }
+
+    WavError readMapped() {
+        const uint8_t* ptr   = (const uint8_t*)Mapping.base;
+        const uint8_t* end   = ptr + Mapping.size;
+        WavError       error = parseHeader(ptr, end);
+        if (error)
+            return error;
+
+        // Point Chunks into the mapping
+        bool        foundData = false;
+        ChunkCursor cursor    = {ptr, end, Ds64, 0};
+        Chunk       chunk;
+        while (cursor.next(chunk))
+            if (!storeChunk(chunk, cursor.size, foundData))
+                return IO_ERROR;
+
+        // Return with the appropiate error code
+        return foundData ? SUCCESS : NO_DATA;
+    }
+
+  public:
+    WavError readMinimal(FILE* file) {
+        // Read Header
+        WavError error = WavFile::readHeader(this, file);
+        if (error)
+            return error;
+
+        // Read first Data Chunk
+        error = WavFile::seekData(this, file);
+        if (error)
+            return error;
+
+        // Read the Data
+        WAV_TIME(STAGE_READ);
+        Data.data = Allocator.allocate(Data.size);
+        readFile(Data.data, Data.size, file);
+
+        return SUCCESS;
+    }
+
+    WavError read(FILE* file) { return read(file, nullptr); }
+
+    // Reads the file as read() does, hashing the samples as they arrive
+    WavError read(FILE* file, WavFingerprint& fingerprint) {
+        WavHash  hash;
+        WavError error = read(file, &hash);
+        fingerprint    = {hash.digest(), formatHash()};
+        return error;
+    }
+
+    // Hash of the audio and its format, see WavFingerprint
+    WavFingerprint fingerprint() const {
+        return {WavHash::of(Data.data, Data.data != nullptr ? Data.size : 0), formatHash()};
+    }
+
+    // Hashes the data chunk across the pool
+    WavFingerprint fingerprint(WavThreadPool& pool) const {
+        return {WavHash::of(Data.data, Data.data != nullptr ? Data.size : 0, pool),
+                formatHash()};
+    }
+
+    // Hash of the decoded sample format only, ignoring how it is written
+    // (plain or WAVE_FORMAT_EXTENSIBLE) and derived fields like byteRate
+    uint64_t formatHash() const {
+        uint32_t canonical[4] = {formatTag(), Format.bitsPerSample, Format.channels,
+                                 Format.sampleRate};
+        return WavHash::of(canonical, sizeof(canonical));
+    }
+
+  private:
+    WavError read(FILE* file, WavHash* hash) {
+        // Read Header
+        WavError error = WavFile::readHeader(this, file);
+        if (error)
+            return error;
+
+        // Read Chunks
+        bool foundData = false;
+        while (true) {
+
+            // Read Chunk and check for eof or error
+            uint64_t size;
+            Chunk    chunk = WavFile::readChunk(file, Allocator, Ds64, size,
+                                                foundData ? nullptr : hash);
+            if (chunk.data == NULL)
+                break;
+
+            if (!storeChunk(chunk, size, foundData)) {
+                Allocator.release(chunk.data);
+                return IO_ERROR;
+            }
+        }
+
+        // Return with the appropiate error code
+        return foundData ? SUCCESS : NO_DATA;
+    }
+
+  public:
+    // Reads the header and records every chunk's tag, size and offset
+    // without reading any payload. Data.size is set, Data.data stays empty
+    // until the data chunk is loaded with loadChunk().
+    WavError probe(FILE* file) {
+        WavError error = WavFile::readHeader(this, file);
+        if (error)
+            return error;
+
+        uint32_t capacity = 16;
+        Index.length      = 0;
+        Index.entries     = (Index::Entry*)Allocator.allocate(sizeof(Index::Entry) * capacity);
+
+        bool foundData = false;
+        while (true) {
+            Index::Entry entry = {};
+            uint32_t     size;
+            if (readFile(&entry.tag, file) != 1 || readFile(&size, file) != 1)
+                break;
+            entry.size   = chunkSize(Ds64, entry.tag, size);
+            entry.offset = ftello(file);
+
+            if (Index.length == capacity) {
+                capacity *= 2;
+                Index.entries = (Index::Entry*)Allocator.reallocate(
+                    Index.entries, sizeof(Index::Entry) * capacity / 2,
+                    sizeof(Index::Entry) * capacity);
+            }
+            Index.entries[Index.length++] = entry;
+
+            if (!foundData && memcmp(entry.tag, "data", 4) == 0) {
+                memcpy(Data.DATA, entry.tag, 4);
+                Data.size = entry.size;
+                foundData = true;
+            }
+
+            // Skip the payload
+            WAV_COUNT(ioCalls, 1);
+            WAV_COUNT(chunksSkipped, 1);
+            if (fseeko(file, entry.size + entry.size % 2, SEEK_CUR) != 0)
+                break;
+        }
+
+        // Open addressing at no more than half load
+        uint32_t slots = 16;
+        while (slots < Index.length * 2)
+            slots *= 2;
+        Index.mask  = slots - 1;
+        Index.table = (uint32_t*)Allocator.allocate(sizeof(uint32_t) * slots);
+        memset(Index.table, 0, sizeof(uint32_t) * slots);
+        for (uint32_t i = 0; i < Index.length; i++) {
+            if (Index.find((const char*)Index.entries[i].tag) != nullptr)
+                continue; // Keep the first of repeated tags
+            uint32_t key;
+            memcpy(&key, Index.entries[i].tag, 4);
+            uint32_t slot = Index::hash(key) & Index.mask;
+            while (Index.table[slot] != 0)
+                slot = (slot + 1) & Index.mask;
+            Index.table[slot] = i + 1;
+        }
+
+        return foundData ? SUCCESS : NO_DATA;
+    }
+
+    // Reads the payload of a chunk found by probe() from the same file.
+    // The first data chunk goes to Data, everything else is appended to
+    // Chunks. Returns the payload, or null when the tag was not found.
+    void* loadChunk(FILE* file, const char* tag) {
+        Index::Entry* entry = Index.find(tag);
+        if (entry == nullptr)
+            return nullptr;
+        return loadChunk(file, *entry);
+    }
+
+    // Loads one entry of Index, which also reaches the second and later
+    // chunks of a repeated tag
+    void* loadChunk(FILE* file, Index::Entry& entry) {
+        if (entry.data != nullptr)
+            return entry.data;
+
+        WAV_TIME(STAGE_READ);
+        WAV_COUNT(ioCalls, 1);
+        void* data = Allocator.allocate(entry.size);
+        if (data == nullptr || fseeko(file, entry.offset, SEEK_SET) != 0 ||
+            (entry.size != 0 && readFile(data, entry.size, file) != 1)) {
+            Allocator.release(data);
+            return nullptr;
+        }
+
+        if (&entry == Index.find("data")) {
+            Data.data = data;
+        } else {
+            Chunk chunk = {{entry.tag[0], entry.tag[1], entry.tag[2], entry.tag[3]},
+                           (uint32_t)entry.size, data};
+            if (!appendChunk(chunk)) {
+                Allocator.release(data);
+                return nullptr;
+            }
+        }
+        entry.data = data;
+        return data;
+    }
+
+    // Parses a file held in memory without allocating or copying.
+    // Data.data points into buf, which must outlive this WavFile and is
+    // not written to unless setData is called. Chunks stays empty, walk
+    // the chunks with chunks() instead.
+    WavError parse(const void* buf, size_t len) {
+        const uint8_t* ptr   = (const uint8_t*)buf;
+        const uint8_t* end   = ptr + len;
+        WavError       error = parseHeader(ptr, end);
+        if (error)
+            return error;
+        Buffer = {ptr, end};
+
+        ChunkCursor cursor = chunks();
+        Chunk       chunk;
+        while (cursor.next(chunk)) {
+            if (memcmp(chunk.tag, "data", 4) == 0) {
+                memcpy(Data.DATA, chunk.tag, 4);
+                Data.size = cursor.size;
+                Data.data = chunk.data;
+                return SUCCESS;
+            }
+        }
+        return NO_DATA;
+    }
+
+    // Every chunk after the format of a buffer given to parse(), data included
+    ChunkCursor chunks() const { return {Buffer.chunks, Buffer.end, Ds64, 0}; }
+
+    // Maps the file at path instead of reading it.
+    // Data and Chunks point straight into the (copy-on-write) mapping,
+    // which is released when the WavFile is destroyed.
+    WavError map(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return IO_ERROR;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            close(fd);
+            return IO_ERROR;
+        }
+
+        void* base = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            return IO_ERROR;
+
+        Mapping.base = base;
+        Mapping.size = info.st_size;
+        return readMapped();
+    }
+
+    // Writes RIFF, or RF64 when the file would pass 4 GB
+    void write(FILE* file) {
+        WAV_TIME(STAGE_WRITE);
+        std::vector<uint8_t> header = buildHeader(Data.size);
+        writeFile(header.data(), header.size(), file);
+        writeFile(Data.data, Data.size, file);
+        if (Data.size % 2 != 0)
+            writeFile(&pad, file);
+
+        // Write Chunks
+        for (int64_t i = 0; i < Chunks.length; i++) {
+            writeFile(&Chunks.chunks[i], sizeof(Chunk) - sizeof(void*), file);
+            writeFile(Chunks.chunks[i].data, Chunks.chunks[i].size, file);
+            if (Chunks.chunks[i].size % 2 != 0)
+                writeFile(&pad, file);
+        }
+    }
+
+    // Writes a new file at path with the format and chunks of this one and
+    // data as its samples. Frames are encoded a cache-sized block at a time
+    // into one staging buffer and leave together with the headers and chunks
+    // in gathered writes, so no interleaved copy of data is ever built and
+    // Data is left alone. Sizes, RF64 included, follow from data.samples.
+    WavError save(const char* path, const WavData<float>& data, bool dither = false) const {
+        if (data.channels != Format.channels) {
+            printf("Error: Channel count mismatch\n");
+            return NO_FORMAT;
+        }
+
+        // Not Supported
+        uint16_t type = formatTag();
+        if (!WavFile::isSupported(type, Format.bitsPerSample)) {
+            return NO_FORMAT;
+        }
+
+        uint32_t             blockSize = Format.blockSize;
+        std::vector<uint8_t> header    = buildHeader((uint64_t)data.samples * blockSize);
+
+        size_t   blockFrames = saveBuffer / blockSize > 0 ? saveBuffer / blockSize : 1;
+        uint8_t* staging     = (uint8_t*)Allocator.allocate(blockFrames * blockSize, 64);
+        if (staging == nullptr)
+            return IO_ERROR;
+
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            Allocator.release(staging);
+            return IO_ERROR;
+        }
+
+        // The header goes out with the first block, the chunks with the last
+        WavDither    noise;
+        struct iovec iov[64];
+        int          count = 0;
+        bool         ok    = true;
+        iov[count++]       = {header.data(), header.size()};
+
+        for (size_t i = 0; ok && i < data.samples; i += blockFrames) {
+            size_t n = data.samples - i < blockFrames ? data.samples - i : blockFrames;
+            WavFile::encode(data.data, i, staging, n, data.channels, Format.bitsPerSample,
+                            type, dither ? &noise : nullptr);
+            iov[count++] = {staging, n * blockSize};
+            if (i + n < data.samples) {
+                ok    = writeAll(fd, iov, count);
+                count = 0;
+            }
+        }
+        if ((uint64_t)data.samples * blockSize % 2 != 0)
+            iov[count++] = {(void*)&pad, 1};
+
+        for (int64_t i = 0; ok && i < Chunks.length; i++) {
+            if (count + 3 > 64) {
+                ok    = writeAll(fd, iov, count);
+                count = 0;
+            }
+            iov[count++] = {(void*)Chunks.chunks[i].tag, 8}; // Tag and size
+            iov[count++] = {Chunks.chunks[i].data, Chunks.chunks[i].size};
+            if (Chunks.chunks[i].size % 2 != 0)
+                iov[count++] = {(void*)&pad, 1};
+        }
+        if (ok && count != 0)
+            ok = writeAll(fd, iov, count);
+
+        Allocator.release(staging);
+        if (::close(fd) != 0)
+            ok = false;
+        return ok ? SUCCESS : IO_ERROR;
+    }
+
+  private:
+    // Everything in front of the samples for dataSize bytes of them followed
+    // by Chunks: RIFF, or RF64 with a ds64 chunk when that passes 4 GB.
+    // Odd sized chunks, data included, count their pad byte.
+    std::vector<uint8_t> buildHeader(uint64_t dataSize) const {
+        uint64_t riffSize = 4 + 8 + Format.formatSize + 8 + dataSize + dataSize % 2;
+        for (int64_t i = 0; i < Chunks.length; i++)
+            riffSize += 8 + Chunks.chunks[i].size + Chunks.chunks[i].size % 2;
+        bool large = riffSize > 0xFFFFFFFF;
+
+        std::vector<uint8_t> header;
+        auto put = [&](const void* src, size_t size) {
+            header.insert(header.end(), (const uint8_t*)src, (const uint8_t*)src + size);
+        };
+
+        struct Descriptor descriptor = Descriptor;
+        memcpy(descriptor.RIFF, large ? "RF64" : "RIFF", 4);
+        descriptor.fileSize = large ? 0xFFFFFFFF : (uint32_t)riffSize;
+        put(&descriptor, sizeof(descriptor));
+
+        if (large) {
+            struct Ds64 ds64 = {riffSize + 8 + 28, dataSize, dataSize / Format.blockSize};
+            uint32_t    size = 28, table = 0;
+            put("ds64", 4);
+            put(&size, 4);
+            put(&ds64, sizeof(ds64));
+            put(&table, 4);
+        }
+
+        put(&Format, sizeof(Format));
+        if (Format.formatSize > 16) {
+            uint32_t extension = Format.formatSize - 16;
+            uint32_t known     = extension < sizeof(Extension) ? extension : sizeof(Extension);
+            put(&Extension, known);
+            header.resize(header.size() + extension - known, 0);
+        }
+
+        uint32_t size = large ? 0xFFFFFFFF : (uint32_t)dataSize;
+        put("data", 4);
+        put(&size, 4);
+        return header;
+    }
+
+    // Bytes encoded per gathered write in save()
+    static constexpr size_t saveBuffer = 256 << 10;
+
+    // Follows every odd sized chunk
+    static constexpr uint8_t pad = 0;
+
+    // Writes every buffer, resuming after short writes and interruptions
+    static bool writeAll(int fd, struct iovec* iov, int count) {
+        WAV_TIME(STAGE_WRITE);
+        while (count > 0) {
+            WAV_COUNT(ioCalls, 1);
+            ssize_t done = writev(fd, iov, count);
+            if (done < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            WAV_COUNT(bytesWritten, done);
+
+            while (count > 0 && (size_t)done >= iov->iov_len) {
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0) {
+                iov->iov_base  = (uint8_t*)iov->iov_base + done;
+                iov->iov_len  -= done;
+            }
+        }
+        return true;
+    }
+
+  public:
+    // Format type of the samples, looking through WAVE_FORMAT_EXTENSIBLE
+    static uint16_t formatTag(const struct Format&    format,
+                              const struct Extension& extension) {
+        if (format.formatType == EXTENSIBLE && format.formatSize >= 40)
+            return extension.subFormat[0] | extension.subFormat[1] << 8;
+        return format.formatType;
+    }
+    uint16_t formatTag() const { return formatTag(Format, Extension); }
+
+    // Whether decode and encode handle the sample format
+    static bool isSupported(uint16_t type, uint32_t bits) {
+        if (type == PCM)
+            return bits == 8 || bits == 16 || bits == 24 || bits == 32;
+        if (type == FLOAT)
+            return bits == 32 || bits == 64;
+        return false;
+    }
+
+    void* getRawData(WavChannelLayout channelLayout) { return getRawData(channelLayout, nullptr); }
+
+    // Frees a buffer returned by getRawData with the same layout.
+    // Interleaved and mono results are Data.data itself and stay.
+    void freeRawData(void* raw, WavChannelLayout channelLayout) {
+        if (raw == nullptr || raw == Data.data || Format.channels <= 1)
+            return;
+        if (channelLayout == SPLIT)
+            Allocator.release(((void**)raw)[0]); // The channels follow the first
+        if (channelLayout == INLINE || channelLayout == SPLIT)
+            Allocator.release(raw);
+    }
+
+    // Typed view of the interleaved samples in Data.data, without copying.
+    // Empty unless T matches the sample width and type (T of const for
+    // read-only views), and Channels, when not 0, the channel count.
+    template <typename T, uint32_t Channels = 0>
+    WavView<T, Channels> view() {
+        typedef typename std::remove_const<T>::type Sample;
+        bool floating = std::is_floating_point<Sample>::value;
+        if (Data.data == nullptr || Format.blockSize != sizeof(T) * Format.channels ||
+            (Channels != 0 && Channels != Format.channels) ||
+            floating != (formatTag() == FLOAT))
+            return {};
+        return WavView<T, Channels>(Data.data, Data.size / Format.blockSize, Format.channels);
+    }
+
+    // Splits the deinterleave of large data chunks across the pool
+    void* getRawData(WavChannelLayout channelLayout, WavThreadPool& pool) {
+        return getRawData(channelLayout, &pool);
+    }
+
+  private:
+    // Frame ranges handed to each thread. Starting every range on a multiple
+    // of 64 frames keeps threads from writing to the same output cache line.
+    static constexpr uint32_t partitionAlign  = 64;
+    static constexpr uint32_t partitionFrames = 1 << 16;
+
+    static size_t partitionCount(size_t frames, WavThreadPool* pool) {
+        if (pool == nullptr || frames < 2 * partitionFrames)
+            return 1;
+        size_t count = frames / partitionFrames;
+        size_t limit = pool->size() * 4; // A few per thread for load balance
+        return count < limit ? count : limit;
+    }
+
+    static size_t partitionStart(size_t frames, size_t count, size_t i) {
+        if (i == count)
+            return frames;
+        size_t start = frames / count * i + frames % count * i / count;
+        return start / partitionAlign * partitionAlign;
+    }
+
+    void* getRawData(WavChannelLayout channelLayout, WavThreadPool* pool) {
+        WAV_TIME(STAGE_DECODE);
+        void*    raw      = Data.data;
+        uint32_t channels = Format.channels;
+        uint32_t bits     = Format.bitsPerSample;
+        size_t   samples  = Data.size / Format.blockSize;
+
+        if (channels <= 1)
+            return raw;
+
+        if (channelLayout == INTERLIEVED)
+            return raw;
+
+        // Unsupported bit depth
+        if (!(bits == 8 || bits == 16 || bits == 24 || bits == 32 || bits == 64))
+            return NULL;
+
+        // SPLIT channels start on their own cache line, like WavData, so
+        // partitions that start on 64 frames never share an output line.
+        // INLINE keeps the channels back to back, as its callers index them.
+        uint32_t  bytes       = bits / 8;
+        size_t    stride      = channelLayout == SPLIT ? (samples * bytes + 63) / 64 * 64
+                                                       : samples * bytes;
+        uint8_t*  data        = (uint8_t*)Allocator.allocate(stride * channels, 64);
+        uint8_t** channelData = (uint8_t**)Allocator.allocate(channels * sizeof(uint8_t*));
+        if (data == nullptr || channelData == nullptr) {
+            Allocator.release(channelData);
+            Allocator.release(data);
+            return NULL;
+        }
+
+        for (uint32_t i = 0; i < channels; i++)
+            channelData[i] = data + i * stride;
+
+        size_t frames = samples;
+        size_t parts  = partitionCount(frames, pool);
+        if (parts == 1) {
+            WavKernel::deinterleave(raw, (void* const*)channelData, 0, samples,
+                                    channels, bytes);
+        } else {
+            uint32_t blockSize = Format.blockSize;
+            pool->parallelFor(parts, [&](size_t i) {
+                size_t start = partitionStart(frames, parts, i);
+                size_t end   = partitionStart(frames, parts, i + 1);
+                WavKernel::deinterleave((const uint8_t*)raw + (size_t)start * blockSize,
+                                        (void* const*)channelData, start, end - start,
+                                        channels, bytes);
+            });
+        }
+
+        if (channelLayout == INLINE) {
+            Allocator.release(channelData);
+            return data;
+        }
+        if (channelLayout == SPLIT)
+            return channelData;
+
+        Allocator.release(channelData);
+        Allocator.release(data);
+        return NULL;
+    }
+
+  public:
+    // Converts interleaved frames of the given format type to planar float,
+    // writing them to dst[c][offset] onwards
+    static void decode(const void* src, float** dst, size_t offset,
+                       size_t frames, uint32_t channels, uint32_t bits,
+                       uint16_t type) {
+        WAV_TIME(STAGE_DECODE);
+
+        // Mono converts straight into the output
+        if (channels == 1) {
+            WavKernel::toFloat(src, dst[0] + offset, frames, bits, type);
+            return;
+        }
+
+        // 32-bit float only needs splitting
+        if (type == FLOAT && bits == 32) {
+            WavKernel::deinterleave(src, (void* const*)dst, offset, frames,
+                                    channels, sizeof(float));
+            return;
+        }
+
+        // Convert a cache-sized block of interleaved samples,
+        // then split it while it is still hot
+        float    block[4096];
+        uint32_t blockFrames = sizeof(block) / sizeof(float) / channels;
+        uint32_t bytes       = bits / 8;
+
+        // Channel counts too large for the block fall back to frame by frame
+        if (blockFrames == 0) {
+            float* frame = (float*)malloc(channels * sizeof(float));
+            for (size_t i = 0; i < frames; i++) {
+                WavKernel::toFloat((const uint8_t*)src + (size_t)i * channels * bytes,
+                                   frame, channels, bits, type);
+                for (uint32_t c = 0; c < channels; c++)
+                    dst[c][offset + i] = frame[c];
+            }
+            free(frame);
+            return;
+        }
+
+        for (size_t i = 0; i < frames; i += blockFrames) {
+            size_t n = frames - i < blockFrames ? frames - i : blockFrames;
+            WavKernel::toFloat((const uint8_t*)src + (size_t)i * channels * bytes,
+                               block, (size_t)n * channels, bits, type);
+            WavKernel::deinterleave(block, (void* const*)dst, offset + i, n,
+                                    channels, sizeof(float));
+        }
+    }
+
+    // Converts interleaved frames to planar float through a channel remix,
+    // writing mix.outputs channels to dst[o][offset] onwards. Input channels
+    // only ever exist for a cache-sized block of frames.
+    static void decode(const void* src, float** dst, size_t offset,
+                       size_t frames, uint32_t channels, uint32_t bits,
+                       uint16_t type, const WavMix& mix) {
+        WAV_TIME(STAGE_DECODE);
+
+        float    block[4096];
+        uint32_t bytes = bits / 8;
+
+        // Few channels: split each block into planes, then sum whole planes
+        if (channels <= 8) {
+            float    planes[4096];
+            float*   plane[8];
+            uint32_t blockFrames = sizeof(block) / sizeof(float) / channels;
+            for (uint32_t c = 0; c < channels; c++)
+                plane[c] = planes + c * blockFrames;
+
+            for (size_t i = 0; i < frames; i += blockFrames) {
+                size_t n = frames - i < blockFrames ? frames - i : blockFrames;
+                WavKernel::toFloat((const uint8_t*)src + (size_t)i * channels * bytes,
+                                   channels == 1 ? planes : block, (size_t)n * channels,
+                                   bits, type);
+                if (channels > 1)
+                    WavKernel::deinterleave(block, (void* const*)plane, 0, n, channels,
+                                            sizeof(float));
+
+                for (uint32_t o = 0; o < mix.outputs; o++) {
+                    const float* gains = mix.row(o);
+                    int          copy  = -1; // The only input, at unity gain
+                    for (uint32_t c = 0; c < channels; c++) {
+                        if (gains[c] == 0)
+                            continue;
+                        copy = copy == -1 && gains[c] == 1 ? (int)c : -2;
+                    }
+                    if (copy >= 0)
+                        memcpy(dst[o] + offset + i, plane[copy], n * sizeof(float));
+                    else
+                        WavKernel::mix(plane, 0, gains, channels, dst[o] + offset + i, n);
+                }
+            }
+            return;
+        }
+
+        // Many channels: each output sample is a frame times a row of gains.
+        // Channel counts too large for the block go frame by frame.
+        uint32_t blockFrames = sizeof(block) / sizeof(float) / channels;
+        float*   buffer      = block;
+        if (blockFrames == 0) {
+            blockFrames = 1;
+            buffer      = (float*)malloc(channels * sizeof(float));
+        }
+
+        for (size_t i = 0; i < frames; i += blockFrames) {
+            size_t n = frames - i < blockFrames ? frames - i : blockFrames;
+            WavKernel::toFloat((const uint8_t*)src + (size_t)i * channels * bytes, buffer,
+                               (size_t)n * channels, bits, type);
+
+            for (uint32_t o = 0; o < mix.outputs; o++) {
+                const float* gains = mix.row(o);
+                float*       out   = dst[o] + offset + i;
+
+                // Rows picking a few channels skip the rest
+                uint32_t used = 0;
+                int      copy = -1;
+                for (uint32_t c = 0; c < channels; c++) {
+                    if (gains[c] == 0)
+                        continue;
+                    used++;
+                    copy = copy == -1 && gains[c] == 1 ? (int)c : -2;
+                }
+
+                for (size_t f = 0; f < n; f++) {
+                    const float* frame = buffer + f * channels;
+                    if (copy >= 0) {
+                        out[f] = frame[copy];
+                        continue;
+                    }
+                    if (used * 4 > channels) {
+                        out[f] = WavKernel::dot(frame, gains, channels);
+                        continue;
+                    }
+                    float sum = 0;
+                    for (uint32_t c = 0; c < channels; c++)
+                        if (gains[c] != 0)
+                            sum += gains[c] * frame[c];
+                    out[f] = sum;
+                }
+            }
+        }
+
+        if (buffer != block)
+            free(buffer);
+    }
+
+    WavData<float> getData() { return getData(nullptr, nullptr); }
+
+    // Splits the decode of large data chunks across the pool,
+    // every thread writing its own frame range of the output
+    WavData<float> getData(WavThreadPool& pool) { return getData(&pool, nullptr); }
+
+    // Decodes mix.outputs channels remixed from the file's channels,
+    // without ever holding all of them as float
+    WavData<float> getData(const WavMix& mix) { return getData(nullptr, &mix); }
+    WavData<float> getData(const WavMix& mix, WavThreadPool& pool) {
+        return getData(&pool, &mix);
+    }
+
+    // Decodes at another sample rate. Blocks of frames are decoded and fed
+    // straight to the resampler, so the samples never exist as float at
+    // the file's own rate.
+    WavData<float> getData(uint32_t sampleRate, uint32_t quality = 16) {
+        if (sampleRate == Format.sampleRate)
+            return getData(nullptr, nullptr);
+
+        // Not Supported
+        if (!WavFile::isSupported(formatTag(), Format.bitsPerSample)) {
+            return {};
+        }
+
+        uint32_t     channels = Format.channels;
+        WavResampler resampler(Allocator);
+        if (!resampler.open(channels, Format.sampleRate, sampleRate, quality))
+            return {};
+
+        size_t         samples = Data.size / Format.blockSize;
+        WavData<float> block(channels, 4096, Allocator);
+        WavData<float> data(channels, resampler.outputFrames(samples), Allocator);
+        if (block.data == nullptr || data.data == nullptr)
+            return {};
+
+        uint16_t type = formatTag();
+        size_t   done = 0;
+        for (size_t i = 0; i < samples; i += block.samples) {
+            size_t n = samples - i < block.samples ? samples - i : block.samples;
+            WavFile::decode((const uint8_t*)Data.data + i * Format.blockSize, block.data, 0,
+                            n, channels, Format.bitsPerSample, type);
+            done += resampler.process(block.data, n, data.data, done);
+        }
+        resampler.flush(data.data, done);
+        return data;
+    }
+
+    // Overview of the samples, read from the 'ovw ' chunk when the file
+    // carries one for the same channels and length, otherwise built in a
+    // single decode pass
+    WavOverview getOverview(uint32_t blockShift = 8) {
+        WavOverview overview;
+        size_t      samples = Format.blockSize != 0 ? Data.size / Format.blockSize : 0;
+
+        auto stored = [&](const Chunk& chunk) {
+            return memcmp(chunk.tag, WavOverview::OVW, 4) == 0 &&
+                   overview.deserialize(chunk.data, chunk.size) == SUCCESS &&
+                   overview.channels == Format.channels && overview.frames == samples;
+        };
+        for (int64_t i = 0; i < Chunks.length; i++)
+            if (stored(Chunks.chunks[i]))
+                return overview;
+        Chunk chunk;
+        for (ChunkCursor cursor = chunks(); cursor.next(chunk);)
+            if (stored(chunk))
+                return overview;
+
+        // Not Supported
+        overview.reset(Format.channels, blockShift);
+        if (!WavFile::isSupported(formatTag(), Format.bitsPerSample)) {
+            return overview;
+        }
+
+        WavData<float> block(Format.channels, 4096, Allocator);
+        if (block.data == nullptr)
+            return overview;
+
+        for (size_t i = 0; i < samples; i += block.samples) {
+            size_t n = samples - i < block.samples ? samples - i : block.samples;
+            WavFile::decode((const uint8_t*)Data.data + i * Format.blockSize, block.data, 0,
+                            n, Format.channels, Format.bitsPerSample, formatTag());
+            overview.add(block.data, n);
+        }
+        overview.finish();
+        return overview;
+    }
+
+    // Stores the overview as an 'ovw ' chunk, replacing any earlier one,
+    // so that write() saves it with the file. Mapped and parsed files
+    // can not take new chunks.
+    bool setOverview(const WavOverview& overview) {
+        if (Mapping.base != nullptr || Buffer.end != nullptr)
+            return false;
+
+        std::vector<uint8_t> payload = overview.serialize();
+        void*                data    = Allocator.allocate(payload.size());
+        if (data == nullptr)
+            return false;
+        memcpy(data, payload.data(), payload.size());
+
+        Chunk chunk;
+        memcpy(chunk.tag, WavOverview::OVW, 4);
+        chunk.size = (uint32_t)payload.size();
+        chunk.data = data;
+
+        for (int64_t i = 0; i < Chunks.length; i++) {
+            if (memcmp(Chunks.chunks[i].tag, WavOverview::OVW, 4) == 0) {
+                Allocator.release(Chunks.chunks[i].data);
+                Chunks.chunks[i] = chunk;
+                return true;
+            }
+        }
+
+        if (!appendChunk(chunk)) {
+            Allocator.release(data);
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    WavData<float> getData(WavThreadPool* pool, const WavMix* mix) {
+        // Not Supported
+        if (!WavFile::isSupported(formatTag(), Format.bitsPerSample)) {
+            return {};
+        }
+        if (mix != nullptr && mix->inputs != Format.channels) {
+            printf("Error: Channel count mismatch\n");
+            return {};
+        }
+
+        // Allocate space for data
+        size_t         samples  = Data.size / Format.blockSize;
+        uint32_t       channels = Format.channels;
+        WavData<float> data(mix ? mix->outputs : channels, samples, Allocator);
+        if (data.data == nullptr)
+            return {};
+
+        uint16_t type  = formatTag();
+        uint32_t bits  = Format.bitsPerSample;
+        size_t   parts = partitionCount(samples, pool);
+
+        uint32_t blockSize = Format.blockSize;
+        auto     decode    = [&](size_t start, size_t end) {
+            const uint8_t* src = (const uint8_t*)Data.data + (size_t)start * blockSize;
+            if (mix != nullptr)
+                WavFile::decode(src, data.data, start, end - start, channels, bits, type, *mix);
+            else
+                WavFile::decode(src, data.data, start, end - start, channels, bits, type);
+        };
+
+        if (parts == 1) {
+            decode(0, samples);
+            return data;
+        }
+
+        pool->parallelFor(parts, [&](size_t i) {
+            decode(partitionStart(samples, parts, i), partitionStart(samples, parts, i + 1));
+        });
+
+        return data;
+    }
+
+  public:
+
+    // Converts planar float frames src[c][offset] onwards into interleaved
+    // frames of the given format type, optionally adding TPDF dither to PCM
+    static void encode(const float* const* src, size_t offset, void* dst,
+                       size_t frames, uint32_t channels, uint32_t bits,
+                       uint16_t type, WavDither* dither = nullptr) {
+        WAV_TIME(STAGE_ENCODE);
+
+        // Mono converts straight from the input
+        if (channels == 1) {
+            WavKernel::fromFloat(src[0] + offset, dst, frames, bits, type, dither);
+            return;
+        }
+
+        // 32-bit float only needs merging
+        if (type == FLOAT && bits == 32) {
+            WavKernel::interleave((const void* const*)src, offset, dst, frames,
+                                  channels, sizeof(float));
+            return;
+        }
+
+        // Merge a cache-sized block of frames, then convert it
+        float    block[4096];
+        uint32_t blockFrames = sizeof(block) / sizeof(float) / channels;
+        uint32_t bytes       = bits / 8;
+
+        // Channel counts too large for the block fall back to frame by frame
+        if (blockFrames == 0) {
+            float* frame = (float*)malloc(channels * sizeof(float));
+            for (size_t i = 0; i < frames; i++) {
+                for (uint32_t c = 0; c < channels; c++)
+                    frame[c] = src[c][offset + i];
+                WavKernel::fromFloat(frame, (uint8_t*)dst + (size_t)i * channels * bytes,
+                                     channels, bits, type, dither);
+            }
+            free(frame);
+            return;
+        }
+
+        for (size_t i = 0; i < frames; i += blockFrames) {
+            size_t n = frames - i < blockFrames ? frames - i : blockFrames;
+            WavKernel::interleave((const void* const*)src, offset + i, block, n,
+                                  channels, sizeof(float));
+            WavKernel::fromFloat(block, (uint8_t*)dst + (size_t)i * channels * bytes,
+                                 (size_t)n * channels, bits, type, dither);
+        }
+    }
+
+    void setData(const WavData<float>& data, bool dither = false) {
+        if (data.channels != Format.channels) {
+            printf("Error: Channel count mismatch\n");
+            return;
+        }
+        if (data.samples != Data.size / Format.blockSize) {
+            printf("Error: Sample count mismatch\n");
+            return;
+        }
+
+        // Not Supported
+        if (!WavFile::isSupported(formatTag(), Format.bitsPerSample)) {
+            return;
+        }
+
+        // Write data
+        WavDither noise;
+        WavFile::encode(data.data, 0, Data.data, data.samples, data.channels,
+                        Format.bitsPerSample, formatTag(), dither ? &noise : nullptr);
+    }
+
+    // Converts the samples to another format type and bit depth in place and
+    // updates Format (and Extension) to match. Chunks and everything else
+    // stay. Samples pass through 32-bit float, so 32-bit PCM and 64-bit float
+    // keep 24 bits of precision, and narrowing to PCM can add TPDF dither.
+    // Narrowing reuses the buffer. Widening grows it, which mapped files
+    // can not do. Parsed files borrow the caller's buffer and can not be
+    // converted at all.
+    WavError convertTo(uint16_t type, uint32_t bits, bool dither = false) {
+        uint16_t from     = formatTag();
+        uint32_t fromBits = Format.bitsPerSample;
+        if (!isSupported(from, fromBits) || !isSupported(type, bits) || Buffer.end != nullptr)
+            return NO_FORMAT;
+        if (Data.data == nullptr)
+            return NO_DATA;
+        if (from == type && fromBits == bits)
+            return SUCCESS;
+
+        bool     owned   = Mapping.base == nullptr;
+        size_t   samples = Data.size / Format.blockSize * Format.channels;
+        uint64_t size    = (uint64_t)samples * (bits / 8);
+        if (size > Data.size) {
+            if (!owned)
+                return NO_FORMAT;
+            void* data = Allocator.reallocate(Data.data, Data.size, size);
+            if (data == nullptr)
+                return IO_ERROR;
+            Data.data = data;
+        }
+
+        WavDither noise;
+        transcode(Data.data, fromBits, from, Data.data, bits, type, samples,
+                  dither ? &noise : nullptr);
+
+        // Hand the tail back to the heap, which can shrink without copying
+        if (size < Data.size && owned && Allocator.alloc == WavAllocator::heapAlloc) {
+            void* data = Allocator.reallocate(Data.data, Data.size, size);
+            if (data != nullptr)
+                Data.data = data;
+        }
+
+        Data.size = size;
+        setFormat(Format, Extension, type, bits);
+        return SUCCESS;
+    }
+
+    // convertTo() from one file to another for files larger than memory.
+    // Samples stream through a small buffer, the other chunks are copied.
+    static WavError convert(const char* src, const char* dst, uint16_t type, uint32_t bits,
+                            bool dither = false,
+                            const WavAllocator& allocator = WavAllocator::heap()) {
+        FILE* in = fopen(src, "rb");
+        if (in == nullptr)
+            return IO_ERROR;
+
+        WavFile  file(allocator);
+        WavError error = file.probe(in);
+        uint16_t from  = file.formatTag();
+        uint32_t width = file.Format.bitsPerSample;
+        if (!error && (!isSupported(from, width) || !isSupported(type, bits)))
+            error = NO_FORMAT;
+
+        // Bring in every chunk but the samples
+        const Index::Entry* samples = error ? nullptr : file.Index.find("data");
+        for (uint32_t i = 0; !error && i < file.Index.length; i++) {
+            Index::Entry& entry = file.Index.entries[i];
+            if (&entry != samples && file.loadChunk(in, entry) == nullptr)
+                error = IO_ERROR;
+        }
+
+        FILE* out = error ? nullptr : fopen(dst, "wb");
+        if (!error && (out == nullptr || fseeko(in, samples->offset, SEEK_SET) != 0))
+            error = IO_ERROR;
+        if (error) {
+            if (out != nullptr)
+                fclose(out);
+            fclose(in);
+            return error;
+        }
+
+        uint32_t channels  = file.Format.channels;
+        uint64_t frames    = file.Data.size / file.Format.blockSize;
+        uint32_t fromBytes = file.Format.blockSize;
+        setFormat(file.Format, file.Extension, type, bits);
+        uint32_t toBytes = file.Format.blockSize;
+
+        std::vector<uint8_t> header = file.buildHeader(frames * toBytes);
+        bool                 ok     = writeFile(header.data(), header.size(), out) == 1;
+
+        size_t   blockFrames = saveBuffer / (fromBytes > toBytes ? fromBytes : toBytes);
+        blockFrames          = blockFrames > 0 ? blockFrames : 1;
+        uint8_t* block       = (uint8_t*)allocator.allocate(
+            blockFrames * (fromBytes > toBytes ? fromBytes : toBytes), 64);
+        ok = ok && block != nullptr;
+
+        WavDither noise;
+        for (uint64_t i = 0; ok && i < frames; i += blockFrames) {
+            size_t n = frames - i < blockFrames ? (size_t)(frames - i) : blockFrames;
+            ok       = readFile(block, n * fromBytes, in) == 1;
+            if (!ok)
+                break;
+            if (from != type || width != bits)
+                transcode(block, width, from, block, bits, type, n * channels,
+                          dither ? &noise : nullptr);
+            ok = writeFile(block, n * toBytes, out) == 1;
+        }
+        if (ok && frames * toBytes % 2 != 0)
+            ok = writeFile(&pad, out) == 1;
+
+        for (int64_t i = 0; ok && i < file.Chunks.length; i++) {
+            const Chunk& chunk = file.Chunks.chunks[i];
+            ok = writeFile(&chunk, sizeof(Chunk) - sizeof(void*), out) == 1 &&
+                 (chunk.size == 0 || writeFile(chunk.data, chunk.size, out) == 1) &&
+                 (chunk.size % 2 == 0 || writeFile(&pad, out) == 1);
+        }
+
+        allocator.release(block);
+        fclose(in);
+        if (fclose(out) != 0)
+            ok = false;
+        return ok ? SUCCESS : IO_ERROR;
+    }
+
+  private:
+    // Format and Extension for the same channels and rate with samples of
+    // another type and width
+    static void setFormat(struct Format& format, struct Extension& extension, uint16_t type,
+                          uint32_t bits) {
+        format.bitsPerSample = bits;
+        format.blockSize     = format.channels * bits / 8;
+        format.byteRate      = format.sampleRate * format.blockSize;
+        if (format.formatType == EXTENSIBLE) {
+            extension.validBitsPerSample = bits;
+            memcpy(extension.subFormat, &type, sizeof(type));
+        } else {
+            format.formatType = type;
+        }
+    }
+
+    // Converts count samples between formats through a block of float.
+    // src and dst may be the same buffer: narrowing runs front to back and
+    // widening back to front, so no sample is overwritten before it is read.
+    static void transcode(const void* src, uint32_t srcBits, uint16_t srcType, void* dst,
+                          uint32_t dstBits, uint16_t dstType, size_t count,
+                          WavDither* dither) {
+        WAV_TIME(STAGE_ENCODE);
+        float  block[4096];
+        size_t blockSize = sizeof(block) / sizeof(float);
+        size_t blocks    = (count + blockSize - 1) / blockSize;
+        bool   backwards = dstBits > srcBits;
+        for (size_t b = 0; b < blocks; b++) {
+            size_t i = (backwards ? blocks - 1 - b : b) * blockSize;
+            size_t n = count - i < blockSize ? count - i : blockSize;
+            WavKernel::toFloat((const uint8_t*)src + i * (srcBits / 8), block, n, srcBits,
+                               srcType);
+            WavKernel::fromFloat(block, (uint8_t*)dst + i * (dstBits / 8), n, dstBits,
+                                 dstType, dither);
+        }
+    }
+
+  public:
+    void print() {
         printf("RIFF:         '%.4s'\n", Descriptor.RIFF);
         printf("FileSize:      %d\n", Descriptor.fileSize);
         printf("WAVE:         '%.4s'\n", Descriptor.WAVE);
@@ -472,25 +3991,751 @@ struct WavFile {
         printf("BlockSize:     %d\n", Format.blockSize);
         printf("BitsPerSample: %d\n", Format.bitsPerSample);
         printf("DATA:         '%.4s'\n", Data.DATA);
-        printf("DataSize:      %d\n", Data.size);
+        printf("DataSize:      %llu\n", (unsigned long long)Data.size);
         Chunks.print();
     }
     static void print(WavFile& wavfile) { wavfile.print(); }
 };
 
+// Reads the data chunk of a file a few frames at a time,
+// keeping memory constant regardless of the file length.
+struct WavStreamReader {
+    struct WavFile::Descriptor Descriptor;
+    struct WavFile::Format     Format;
+    struct WavFile::Extension  Extension;
+    uint64_t                   frames;   // Total frames in the data chunk
+    uint64_t                   position; // Frames read so far
+
+  private:
+    FILE*   file;
+    uint8_t buffer[16384]; // Staging for planar reads
+
+  public:
+    WavStreamReader()
+        : Descriptor{}, Format{}, Extension{}, frames(0), position(0), file(nullptr) {}
+
+    // Parses the header and positions the file at the first sample.
+    // The file is not owned and must outlive the reader.
+    WavError open(FILE* file) {
+        WavFile  header;
+        WavError error = WavFile::readHeader(&header, file);
+        if (error)
+            return error;
+
+        error = WavFile::seekData(&header, file);
+        if (error)
+            return error;
+
+        if (header.Format.blockSize == 0)
+            return NO_FORMAT;
+
+        Descriptor = header.Descriptor;
+        Format     = header.Format;
+        Extension  = header.Extension;
+        frames     = header.Data.size / Format.blockSize;
+        position   = 0;
+        this->file = file;
+        return SUCCESS;
+    }
+
+    uint64_t remaining() const { return frames - position; }
+
+    // Reads up to count frames in their native interleaved format.
+    // Returns the number of frames read.
+    uint32_t read(void* dst, uint32_t count) {
+        if (count > remaining())
+            count = (uint32_t)remaining();
+
+        WAV_TIME(STAGE_READ);
+        WAV_COUNT(ioCalls, 1);
+        uint32_t got = fread(dst, Format.blockSize, count, file);
+        WAV_COUNT(bytesRead, (uint64_t)got * Format.blockSize);
+        position    += got;
+        return got;
+    }
+
+    // Reads up to count frames, converting them to planar float.
+    // dst holds one buffer per channel of at least count floats.
+    // Returns the number of frames read.
+    uint32_t read(float** dst, uint32_t count) {
+        // Not Supported
+        uint16_t type = WavFile::formatTag(Format, Extension);
+        if (!WavFile::isSupported(type, Format.bitsPerSample)) {
+            return 0;
+        }
+
+        // Frames too large for the staging buffer fall back to frame by frame
+        uint8_t* staging = buffer;
+        uint32_t block   = sizeof(buffer) / Format.blockSize;
+        if (block == 0) {
+            staging = (uint8_t*)malloc(Format.blockSize);
+            if (staging == nullptr)
+                return 0;
+            block = 1;
+        }
+
+        uint32_t done = 0;
+        while (done < count) {
+            uint32_t want = count - done < block ? count - done : block;
+            uint32_t got  = read((void*)staging, want);
+            if (got == 0)
+                break;
+
+            WavFile::decode(staging, dst, done, got, Format.channels,
+                            Format.bitsPerSample, type);
+            done += got;
+        }
+
+        if (staging != buffer)
+            free(staging);
+        return done;
+    }
+};
+
+// Reads arbitrary frame ranges of one open file. Reads use positional I/O
+// and share no seek state, so any number of threads may read at once.
+struct WavFrameReader {
+    struct WavFile::Descriptor Descriptor;
+    struct WavFile::Format     Format;
+    struct WavFile::Extension  Extension;
+    uint64_t                   frames; // Total frames in the data chunk
+
+  private:
+    int      fd;
+    uint64_t dataOffset; // File position of the first sample
+
+  public:
+    WavFrameReader()
+        : Descriptor{}, Format{}, Extension{}, frames(0), fd(-1), dataOffset(0) {}
+    WavFrameReader(const WavFrameReader& other) = delete;
+    ~WavFrameReader() { close(); }
+
+    WavError open(const char* path) {
+        close();
+
+        FILE* file = fopen(path, "rb");
+        if (file == NULL)
+            return IO_ERROR;
+
+        WavFile  header;
+        WavError error = WavFile::readHeader(&header, file);
+        if (!error)
+            error = WavFile::seekData(&header, file);
+        if (!error && header.Format.blockSize == 0)
+            error = NO_FORMAT;
+
+        dataOffset = ftello(file);
+        fclose(file);
+        if (error)
+            return error;
+
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return IO_ERROR;
+
+        Descriptor = header.Descriptor;
+        Format     = header.Format;
+        Extension  = header.Extension;
+        frames     = header.Data.size / Format.blockSize;
+        return SUCCESS;
+    }
+
+    void close() {
+        if (fd >= 0)
+            ::close(fd);
+        fd     = -1;
+        frames = 0;
+    }
+
+    // Reads up to count frames starting at frame offset in their native
+    // interleaved format. Returns the number of frames read.
+    size_t readFrames(uint64_t offset, size_t count, void* dst) const {
+        WAV_TIME(STAGE_READ);
+        if (offset >= frames)
+            return 0;
+        if (count > frames - offset)
+            count = frames - offset;
+
+        uint8_t* out   = (uint8_t*)dst;
+        size_t   bytes = count * Format.blockSize;
+        off_t    from  = dataOffset + offset * Format.blockSize;
+        size_t   done  = 0;
+        while (done < bytes) {
+            WAV_COUNT(ioCalls, 1);
+            ssize_t got = pread(fd, out + done, bytes - done, from + done);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            WAV_COUNT(bytesRead, got);
+            done += got;
+        }
+        return done / Format.blockSize;
+    }
+
+    // Reads up to count frames starting at frame offset, converting them to
+    // planar float. dst holds one buffer per channel of at least count floats.
+    // Returns the number of frames read.
+    size_t readFrames(uint64_t offset, size_t count, float** dst) const {
+        // Not Supported
+        uint16_t type = WavFile::formatTag(Format, Extension);
+        if (!WavFile::isSupported(type, Format.bitsPerSample)) {
+            return 0;
+        }
+
+        // Frames too large for the staging buffer fall back to frame by frame
+        uint8_t  buffer[16384]; // Per call, so threads never share it
+        uint8_t* staging = buffer;
+        size_t   block   = sizeof(buffer) / Format.blockSize;
+        if (block == 0) {
+            staging = (uint8_t*)malloc(Format.blockSize);
+            if (staging == nullptr)
+                return 0;
+            block = 1;
+        }
+
+        size_t done = 0;
+        while (done < count) {
+            size_t want = count - done < block ? count - done : block;
+            size_t got  = readFrames(offset + done, want, (void*)staging);
+            if (got == 0)
+                break;
+
+            WavFile::decode(staging, dst, done, got, Format.channels,
+                            Format.bitsPerSample, type);
+            done += got;
+        }
+
+        if (staging != buffer)
+            free(staging);
+        return done;
+    }
+};
+
+// Reads the data chunk sequentially with a background thread fetching the
+// next blocks into a ring of buffers. Decoding a block on the consumer side
+// overlaps with the read of the ones after it.
+struct WavPrefetchReader {
+    struct WavFile::Descriptor Descriptor;
+    struct WavFile::Format     Format;
+    struct WavFile::Extension  Extension;
+    uint64_t                   frames;      // Total frames in the data chunk
+    size_t                     blockFrames; // Frames per block, the last may be shorter
+
+    struct Block {
+        const void* data; // Interleaved frames in the native format
+        size_t      frames;
+        uint64_t    position; // Frame offset of the first frame
+    };
+
+  private:
+    WavFrameReader          reader;
+    WavAllocator            allocator;
+    uint8_t**               buffers;
+    Block*                  blocks;
+    uint32_t                depth;
+    uint32_t                head; // Next slot to fill
+    uint32_t                tail; // Next slot to hand out
+    uint32_t                ready;
+    bool                    held; // The consumer still uses the slot before tail
+    bool                    finished;
+    bool                    stopping;
+    WavError                status;
+    std::mutex              mutex;
+    std::condition_variable filledSlot;
+    std::condition_variable freedSlot;
+    std::thread             thread;
+
+  public:
+    WavPrefetchReader(const WavAllocator& allocator = WavAllocator::heap())
+        : Descriptor{}, Format{}, Extension{}, frames(0), blockFrames(0), allocator(allocator),
+          buffers(nullptr), blocks(nullptr), depth(0), head(0), tail(0), ready(0), held(false),
+          finished(false), stopping(false), status(SUCCESS) {}
+    WavPrefetchReader(const WavPrefetchReader& other) = delete;
+    ~WavPrefetchReader() { close(); }
+
+    // Starts reading ahead by up to depth blocks of about blockSize bytes
+    WavError open(const char* path, size_t blockSize = 1 << 20, uint32_t depth = 3) {
+        close();
+
+        WavError error = reader.open(path);
+        if (error)
+            return error;
+
+        Descriptor  = reader.Descriptor;
+        Format      = reader.Format;
+        Extension   = reader.Extension;
+        frames      = reader.frames;
+        blockFrames = blockSize / Format.blockSize;
+        if (blockFrames == 0)
+            blockFrames = 1;
+
+        this->depth = depth < 2 ? 2 : depth;
+        buffers     = (uint8_t**)allocator.allocate(sizeof(uint8_t*) * this->depth);
+        blocks      = (Block*)allocator.allocate(sizeof(Block) * this->depth);
+        if (buffers != nullptr)
+            memset(buffers, 0, sizeof(uint8_t*) * this->depth);
+        bool allocated = buffers != nullptr && blocks != nullptr;
+        for (uint32_t i = 0; allocated && i < this->depth; i++) {
+            buffers[i] = (uint8_t*)allocator.allocate(blockFrames * Format.blockSize, 64);
+            allocated  = buffers[i] != nullptr;
+        }
+        if (!allocated) {
+            close();
+            return IO_ERROR;
+        }
+
+        head     = 0;
+        tail     = 0;
+        ready    = 0;
+        held     = false;
+        finished = false;
+        stopping = false;
+        status   = SUCCESS;
+        thread   = std::thread([this] { fetch(); });
+        return SUCCESS;
+    }
+
+    // Stops the background thread and frees the buffers
+    void close() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            freedSlot.notify_one();
+            thread.join();
+        }
+
+        for (uint32_t i = 0; buffers != nullptr && i < depth; i++)
+            allocator.release(buffers[i]);
+        allocator.release(buffers);
+        allocator.release(blocks);
+        buffers = nullptr;
+        blocks  = nullptr;
+        depth   = 0;
+        reader.close();
+    }
+
+    // Hands out the next block, waiting for it if it has not been read yet.
+    // The block stays valid until the next call. Returns false at the end
+    // of the data or after a read error.
+    bool next(Block& block) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (held) {
+            tail = (tail + 1) % depth;
+            held = false;
+            freedSlot.notify_one();
+        }
+
+        filledSlot.wait(lock, [this] { return ready != 0 || finished; });
+        if (ready == 0)
+            return false;
+
+        block = blocks[tail];
+        ready--;
+        held = true;
+        return true;
+    }
+
+    // Decodes the next block to planar float. dst holds one buffer per
+    // channel of at least blockFrames floats. Returns the number of frames,
+    // 0 at the end of the data.
+    size_t next(float** dst) {
+        // Not Supported
+        uint16_t type = WavFile::formatTag(Format, Extension);
+        if (!WavFile::isSupported(type, Format.bitsPerSample)) {
+            return 0;
+        }
+
+        Block block;
+        if (!next(block))
+            return 0;
+        WavFile::decode(block.data, dst, 0, block.frames, Format.channels,
+                        Format.bitsPerSample, type);
+        return block.frames;
+    }
+
+    // IO_ERROR once a read came up short
+    WavError error() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return status;
+    }
+
+  private:
+    void fetch() {
+        for (uint64_t position = 0; position < frames;) {
+            // Wait for a slot the consumer is done with
+            uint32_t slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                freedSlot.wait(lock, [this] { return stopping || ready + held < depth; });
+                if (stopping)
+                    break;
+                slot = head;
+            }
+
+            size_t want = frames - position < blockFrames ? frames - position : blockFrames;
+            size_t got  = reader.readFrames(position, want, (void*)buffers[slot]);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (got != 0) {
+                blocks[slot] = {buffers[slot], got, position};
+                head         = (head + 1) % depth;
+                ready++;
+                position += got;
+            }
+            if (got != want) {
+                status = IO_ERROR;
+                break;
+            }
+            filledSlot.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        filledSlot.notify_one();
+    }
+};
+
+// Writes a file a few frames at a time through a fixed-size aligned buffer.
+// The RIFF and data sizes are patched in by finalize(). A JUNK chunk
+// reserves room for a ds64 chunk, so files that pass 4 GB become RF64.
+struct WavStreamWriter {
+    struct WavFile::Format    Format;
+    struct WavFile::Extension Extension;
+    uint64_t                  frames; // Frames written so far
+    bool                      dither; // Add TPDF dither when encoding float to PCM
+
+  private:
+    FILE*        file;
+    off_t        start; // File position of the descriptor
+    uint8_t*     buffer;
+    size_t       used;
+    size_t       capacity;
+    WavDither    noise;
+    WavAllocator allocator;
+    WavError     error;
+
+  public:
+    WavStreamWriter(const WavAllocator& allocator = WavAllocator::heap())
+        : Format{}, Extension{}, frames(0), dither(false), file(nullptr), start(0),
+          buffer(nullptr), used(0), capacity(0), allocator(allocator), error(SUCCESS) {}
+    WavStreamWriter(const WavStreamWriter& other) = delete;
+    ~WavStreamWriter() {
+        if (file != nullptr)
+            finalize();
+        allocator.release(buffer);
+    }
+
+    // Writes a header with placeholder sizes at the current file position.
+    // Formats beyond 16-bit stereo PCM use WAVE_FORMAT_EXTENSIBLE.
+    // The file is not owned and must outlive the writer.
+    WavError open(FILE* file, uint16_t type, uint16_t channels, uint32_t sampleRate,
+                  uint16_t bitsPerSample, size_t bufferSize = 1 << 20) {
+        if (!WavFile::isSupported(type, bitsPerSample) || channels == 0)
+            return NO_FORMAT;
+
+        bool extensible = channels > 2 || bitsPerSample > 16;
+
+        memcpy(Format.FMT, WavFile::fmt, 4);
+        Format.formatSize    = extensible ? 40 : type == PCM ? 16 : 18;
+        Format.formatType    = extensible ? (uint16_t)EXTENSIBLE : type;
+        Format.channels      = channels;
+        Format.sampleRate    = sampleRate;
+        Format.blockSize     = channels * bitsPerSample / 8;
+        Format.byteRate      = sampleRate * Format.blockSize;
+        Format.bitsPerSample = bitsPerSample;
+
+        // KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT, differing only in the type
+        static const uint8_t subFormat[16] = {0, 0, 0, 0, 0x00, 0x00, 0x10, 0x00,
+                                              0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        Extension                    = {};
+        Extension.size               = extensible ? 22 : 0;
+        Extension.validBitsPerSample = extensible ? bitsPerSample : 0;
+        memcpy(Extension.subFormat, subFormat, 16);
+        Extension.subFormat[0] = type;
+        Extension.subFormat[1] = type >> 8;
+
+        // Whole frames, rounded down to the buffer alignment
+        capacity = bufferSize / 64 * 64;
+        capacity = capacity / Format.blockSize * Format.blockSize;
+        if (capacity == 0)
+            capacity = Format.blockSize;
+        allocator.release(buffer);
+        buffer = (uint8_t*)allocator.allocate(capacity, 64);
+        if (buffer == nullptr)
+            return IO_ERROR;
+
+        this->file = file;
+        start      = ftello(file);
+        frames     = 0;
+        used       = 0;
+        error      = SUCCESS;
+
+        struct WavFile::Descriptor descriptor;
+        memcpy(descriptor.RIFF, WavFile::RIFF, 4);
+        descriptor.fileSize = 0;
+        memcpy(descriptor.WAVE, WavFile::WAVE, 4);
+
+        uint32_t dataSize = 0;
+        uint32_t junkSize = 28;
+        uint8_t  junk[28] = {};
+        writeFile(&descriptor, file);
+        fwrite("JUNK", 4, 1, file);
+        writeFile(&junkSize, file);
+        writeFile(&junk, file);
+        writeFile(&Format, file);
+        if (Format.formatSize > 16)
+            writeFile(&Extension, Format.formatSize - 16, file);
+        fwrite("data", 4, 1, file);
+        writeFile(&dataSize, file);
+
+        return ferror(file) ? IO_ERROR : SUCCESS;
+    }
+
+    // Appends count frames in the native interleaved format
+    uint32_t write(const void* src, uint32_t count) {
+        const uint8_t* in    = (const uint8_t*)src;
+        size_t         bytes = (size_t)count * Format.blockSize;
+
+        // Large writes bypass the buffer once it is drained
+        if (bytes >= capacity) {
+            flush();
+            put(in, bytes);
+            frames += count;
+            return count;
+        }
+
+        if (used + bytes > capacity)
+            flush();
+        memcpy(buffer + used, in, bytes);
+        used   += bytes;
+        frames += count;
+        return count;
+    }
+
+    // Appends count frames of planar float, converting them to the file format
+    uint32_t write(const float* const* src, uint32_t count) {
+        uint16_t type = WavFile::formatTag(Format, Extension);
+        uint32_t done = 0;
+        while (done < count) {
+            if (used == capacity)
+                flush();
+
+            uint32_t space = (capacity - used) / Format.blockSize;
+            uint32_t n     = count - done < space ? count - done : space;
+            WavFile::encode(src, done, buffer + used, n, Format.channels,
+                            Format.bitsPerSample, type, dither ? &noise : nullptr);
+            used += (size_t)n * Format.blockSize;
+            done += n;
+        }
+        frames += count;
+        return count;
+    }
+
+    // Flushes the buffer, pads the data chunk to an even size and
+    // patches the RIFF and data sizes. The writer can not be used afterwards.
+    WavError finalize() {
+        if (file == nullptr)
+            return error;
+
+        flush();
+        uint64_t dataSize = frames * Format.blockSize;
+        if (dataSize % 2 != 0)
+            fputc(0, file);
+
+        uint32_t header   = 12 + 36 + 8 + Format.formatSize + 8;
+        uint64_t riffSize = header - 8 + dataSize + dataSize % 2;
+        off_t    end      = ftello(file);
+
+        if (riffSize <= 0xFFFFFFFF) {
+            uint32_t fileSize = (uint32_t)riffSize;
+            uint32_t size     = (uint32_t)dataSize;
+            fseeko(file, start + 4, SEEK_SET);
+            writeFile(&fileSize, file);
+            fseeko(file, start + header - 4, SEEK_SET);
+            writeFile(&size, file);
+        } else {
+            // Turn the JUNK chunk into ds64 and mark the 32-bit sizes unused
+            struct WavFile::Ds64 ds64   = {riffSize, dataSize, frames};
+            uint32_t             marker = 0xFFFFFFFF;
+            fseeko(file, start, SEEK_SET);
+            fwrite("RF64", 4, 1, file);
+            writeFile(&marker, file);
+            fseeko(file, start + 12, SEEK_SET);
+            fwrite("ds64", 4, 1, file);
+            fseeko(file, start + 20, SEEK_SET);
+            writeFile(&ds64, file);
+            fseeko(file, start + header - 4, SEEK_SET);
+            writeFile(&marker, file);
+        }
+        fseeko(file, end, SEEK_SET);
+        fflush(file);
+
+        if (ferror(file))
+            error = IO_ERROR;
+        file = nullptr;
+        return error;
+    }
+
+  private:
+    void put(const uint8_t* src, size_t bytes) {
+        WAV_TIME(STAGE_WRITE);
+        if (bytes != 0 && writeFile(src, bytes, file) != 1)
+            error = IO_ERROR;
+    }
+
+    void flush() {
+        put(buffer, used);
+        used = 0;
+    }
+};
+
 struct WavLoader {
-    static WavFile readFile(const char* path) {
+    // One file of a batch, handed to the callback once it is loaded
+    struct Result {
+        size_t         index; // Position in the path list
+        const char*    path;
+        WavError       error;
+        WavFile        file;
+        WavData<float> data; // Planar float, only filled in when decoding
+    };
+    typedef std::function<void(Result& result)> Callback;
+
+    static WavFile readFile(const char*         path,
+                            const WavAllocator& allocator = WavAllocator::heap()) {
         FILE* file = fopen(path, "rb");
         if (file == NULL) {
             printf("Error: Could not open file %s\n", path);
-            return {};
+            return WavFile(allocator);
         }
 
-        WavFile wavfile;
+        WavFile wavfile(allocator);
         wavfile.read(file);
         fclose(file);
         return wavfile;
     }
+
+    // Reads only the header and chunk index, see WavFile::probe
+    static WavFile probeFile(const char*         path,
+                             const WavAllocator& allocator = WavAllocator::heap()) {
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+            printf("Error: Could not open file %s\n", path);
+            return WavFile(allocator);
+        }
+
+        // Headers are small, keep each read to a single block
+        char buffer[512];
+        setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+        WavFile wavfile(allocator);
+        wavfile.probe(file);
+        fclose(file);
+        return wavfile;
+    }
+
+    static WavFile mapFile(const char*         path,
+                           const WavAllocator& allocator = WavAllocator::heap()) {
+        WavFile wavfile(allocator);
+        if (wavfile.map(path) == IO_ERROR)
+            printf("Error: Could not open file %s\n", path);
+        return wavfile;
+    }
+
+    // Reads every path on the pool and calls back in completion order.
+    // At most maxInFlight files (two per thread when 0) are loading or
+    // waiting for the callback at any time. The callback runs on the calling
+    // thread, and the result is freed when it returns unless moved out.
+    // The allocator must be thread-safe, and this must not be called from
+    // inside a task of the same pool.
+    static void readMany(const char* const* paths, size_t count, const Callback& callback,
+                         bool decode = false, WavThreadPool& pool = WavThreadPool::shared(),
+                         size_t              maxInFlight = 0,
+                         const WavAllocator& allocator   = WavAllocator::heap()) {
+        if (maxInFlight == 0)
+            maxInFlight = 2 * (size_t)pool.size();
+
+        std::mutex              mutex;
+        std::condition_variable ready;
+        std::deque<Result*>     finished;
+        size_t                  submitted = 0;
+        size_t                  delivered = 0;
+
+        auto deliver = [&] {
+            Result* result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return !finished.empty(); });
+                result = finished.front();
+                finished.pop_front();
+            }
+            callback(*result);
+            delete result;
+            delivered++;
+        };
+
+        for (; submitted < count; submitted++) {
+            if (submitted - delivered >= maxInFlight)
+                deliver();
+
+            Result* result = new Result{submitted, paths[submitted], SUCCESS,
+                                        WavFile(allocator), WavData<float>()};
+            pool.submit([result, decode, &mutex, &ready, &finished] {
+                load(*result, decode);
+                // Notify under the lock, the caller may return as soon as it is released
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(result);
+                ready.notify_one();
+            });
+        }
+        while (delivered < count)
+            deliver();
+    }
+
+    // Reads every .wav file in a directory, submitted in name order
+    static WavError readMany(const char* directory, const Callback& callback,
+                             bool decode = false, WavThreadPool& pool = WavThreadPool::shared(),
+                             size_t              maxInFlight = 0,
+                             const WavAllocator& allocator   = WavAllocator::heap()) {
+        DIR* dir = opendir(directory);
+        if (dir == NULL)
+            return IO_ERROR;
+
+        std::vector<std::string> names;
+        while (struct dirent* entry = readdir(dir)) {
+            size_t length = strlen(entry->d_name);
+            if (length > 4 && strcasecmp(entry->d_name + length - 4, ".wav") == 0)
+                names.push_back(std::string(directory) + "/" + entry->d_name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+
+        std::vector<const char*> paths;
+        for (const std::string& name : names)
+            paths.push_back(name.c_str());
+
+        readMany(paths.data(), paths.size(), callback, decode, pool, maxInFlight, allocator);
+        return SUCCESS;
+    }
+
+  private:
+    static void load(Result& result, bool decode) {
+        FILE* file = fopen(result.path, "rb");
+        if (file == NULL) {
+            result.error = IO_ERROR;
+            return;
+        }
+        result.error = result.file.read(file);
+        fclose(file);
+
+        if (result.error == SUCCESS && decode) {
+            result.data = result.file.getData();
+            if (result.data.data == nullptr && result.file.Data.size != 0)
+                result.error = NO_FORMAT;
+        }
+    }
 };
 
-#endif
\ No newline at end of file
+#endif